@@ -0,0 +1,526 @@
+//========================================================//
+//  bench.c                                               //
+//  Micro-benchmark of predictor throughput in ns/branch  //
+//  with a regression check against a stored baseline     //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "predictor.h"
+#include "sim.h"
+#include "trace.h"
+
+// Benchmark modes, timed on every run
+#define MODE_TRAIN    0   // predictor_predict_batch on a fresh predictor
+#define MODE_PREDICT  1   // predictor_predict only, on the trained predictor
+#define MODES         2
+
+const char *mode_names[MODES] = {"predict+train", "predict"};
+
+// A stream of branches held in memory, so that the trace reader is not
+// part of the measurement
+struct stream
+{
+  char name[64];
+  uint32_t *pcs;
+  uint8_t *outcomes;
+  size_t n;
+};
+
+// Timings of one predictor on one stream in one mode
+struct row
+{
+  int type;
+  char predictor[512];
+  const char *stream;
+  int mode;
+  size_t branches;
+  double median;            // ns/branch
+  double p10;
+  double p90;
+  double min;
+  double baseline;          // Median of the baseline, 0 if there is none
+};
+
+struct predictor_config *configs;
+int num_configs = 0;
+struct stream *streams;
+int num_streams = 0;
+struct row *rows;
+int num_rows = 0;
+
+const char *default_traces = "fp_1,fp_2,int_1,int_2,mm_1,mm_2";
+const char *default_synthetic = "loop,biased,random";
+const char *trace_dir = "../traces";
+size_t max_branches = 1000000;
+int runs = 7;
+int warmup = 1;
+double tolerance = 10.0;
+
+void
+usage()
+{
+  fprintf(stderr,"Usage: bench <options> [<type>[:<param>...] ...]\n");
+  fprintf(stderr," Times every predictor (default: each type in its default configuration)\n");
+  fprintf(stderr," on the start of each trace and on synthetic streams held in memory\n");
+  fprintf(stderr," Options:\n");
+  fprintf(stderr," --help              Print this message\n");
+  fprintf(stderr," --traces=<t>,...    Trace names or paths (default %s)\n", default_traces);
+  fprintf(stderr," --trace-dir=<dir>   Where trace names are looked up (default %s)\n", trace_dir);
+  fprintf(stderr," --synthetic=<s>,... Synthetic streams (default %s)\n", default_synthetic);
+  fprintf(stderr," --branches=<n>      Branches per stream (default %zu)\n", max_branches);
+  fprintf(stderr," --runs=<n>          Timed runs per measurement (default %d)\n", runs);
+  fprintf(stderr," --warmup=<n>        Untimed runs before them (default %d)\n", warmup);
+  fprintf(stderr," --output=<file>     Write the results as CSV to <file>\n");
+  fprintf(stderr," --baseline=<file>   Compare the medians with an earlier --output\n");
+  fprintf(stderr," --tolerance=<pct>   Slowdown over the baseline that fails (default %.0f)\n",
+          tolerance);
+  fprintf(stderr," The exit status is 1 if any predictor is slower than the baseline by more\n"
+                 " than the tolerance in either mode, taking the geometric mean of its\n"
+                 " change in median over the streams\n");
+}
+
+//------------------------------------//
+//              Streams               //
+//------------------------------------//
+
+struct stream *
+new_stream(const char *name, size_t cap)
+{
+  streams = realloc(streams, (num_streams + 1) * sizeof(*streams));
+  struct stream *s = &streams[num_streams++];
+  snprintf(s->name, sizeof(s->name), "%s", name);
+  s->pcs = malloc(cap * sizeof(*s->pcs));
+  s->outcomes = malloc(cap);
+  s->n = 0;
+  return s;
+}
+
+// Read up to max_branches branches of the trace at 'arg'
+//
+// Returns True if Successful
+//
+int
+load_trace(const char *arg)
+{
+  char path[4096], name[256];
+  sim_resolve_trace(arg, trace_dir, path, sizeof(path), name, sizeof(name));
+  struct trace *t = trace_open(path);
+  if (!t) {
+    return 0;
+  }
+
+  struct stream *s = new_stream(name, max_branches);
+  const uint32_t *pcs;
+  const uint8_t *outcomes;
+  size_t n;
+  while (s->n < max_branches && (n = trace_next(t, &pcs, &outcomes)) > 0) {
+    if (n > max_branches - s->n) {
+      n = max_branches - s->n;
+    }
+    memcpy(s->pcs + s->n, pcs, n * sizeof(*pcs));
+    memcpy(s->outcomes + s->n, outcomes, n);
+    s->n += n;
+  }
+  int ok = !trace_error(t) && s->n > 0;
+  if (!ok) {
+    fprintf(stderr, "%s: %s\n", path, trace_error(t) ? trace_error(t) : "empty trace");
+  }
+  trace_close(t);
+  return ok;
+}
+
+// xorshift32, so that the synthetic streams are the same everywhere
+//
+static inline uint32_t
+next_random(uint32_t *state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+// Generate the synthetic stream 'name':
+//   loop    nested loops of 3 x 7 x 11 iterations around a few if/else
+//           branches that follow the loop counters
+//   biased  256 branches in a random order, each taken with its own
+//           fixed probability
+//   random  4096 branches in a random order with random outcomes, the
+//           worst case for table locality and for the predictor
+//
+// Returns True if 'name' is a known stream
+//
+int
+make_synthetic(const char *name)
+{
+  uint32_t state = 0x2545F491;
+  struct stream *s;
+
+  if (!strcmp(name, "loop")) {
+    s = new_stream(name, max_branches);
+    while (s->n < max_branches) {
+      for (int i = 0; i < 3 && s->n < max_branches; i++) {
+        for (int j = 0; j < 7 && s->n < max_branches; j++) {
+          for (int k = 0; k < 11 && s->n < max_branches; k++) {
+            s->pcs[s->n] = 0x400100;
+            s->outcomes[s->n++] = k < 10;
+            if (s->n < max_branches) {
+              s->pcs[s->n] = 0x400120;
+              s->outcomes[s->n++] = (i + k) % 3 == 0;
+            }
+          }
+          if (s->n < max_branches) {
+            s->pcs[s->n] = 0x400140;
+            s->outcomes[s->n++] = j < 6;
+          }
+        }
+        if (s->n < max_branches) {
+          s->pcs[s->n] = 0x400160;
+          s->outcomes[s->n++] = i < 2;
+        }
+      }
+    }
+  } else if (!strcmp(name, "biased")) {
+    s = new_stream(name, max_branches);
+    for (; s->n < max_branches; s->n++) {
+      uint32_t r = next_random(&state);
+      uint32_t branch = r & 255;
+      s->pcs[s->n] = 0x500000 + branch * 4;
+      // Branch b is taken with probability (b + 1) / 256
+      s->outcomes[s->n] = (next_random(&state) & 255) <= branch;
+    }
+  } else if (!strcmp(name, "random")) {
+    s = new_stream(name, max_branches);
+    for (; s->n < max_branches; s->n++) {
+      uint32_t r = next_random(&state);
+      s->pcs[s->n] = 0x600000 + (r & 4095) * 4;
+      s->outcomes[s->n] = (r >> 16) & 1;
+    }
+  } else {
+    fprintf(stderr, "Unknown synthetic stream %s\n", name);
+    return 0;
+  }
+  return 1;
+}
+
+// Call 'add' on every item of a ',' separated list
+//
+// Returns True if every call succeeded
+//
+int
+for_each_item(const char *list, int (*add)(const char *))
+{
+  while (*list) {
+    size_t len = strcspn(list, ",");
+    if (len > 0) {
+      char item[4096];
+      snprintf(item, sizeof(item), "%.*s", (int)len, list);
+      if (!add(item)) {
+        return 0;
+      }
+    }
+    list += len + (list[len] == ',');
+  }
+  return 1;
+}
+
+//------------------------------------//
+//            Measurement             //
+//------------------------------------//
+
+// Run a fresh predictor over 's' once, training it, then once more
+// predicting only, and store the ns/branch of both passes in 'ns'
+//
+void
+time_run(const struct predictor_config *cfg, const struct stream *s, double *ns)
+{
+  struct predictor *p = predictor_create(cfg);
+  volatile uint32_t sink = 0;
+
+  double start = sim_now();
+  for (size_t i = 0; i < s->n; i += TRACE_BATCH) {
+    size_t n = s->n - i < TRACE_BATCH ? s->n - i : TRACE_BATCH;
+    sink += predictor_predict_batch(p, s->pcs + i, s->outcomes + i, n, NULL);
+  }
+  ns[MODE_TRAIN] = (sim_now() - start) * 1e9 / s->n;
+
+  start = sim_now();
+  uint32_t taken = 0;
+  for (size_t i = 0; i < s->n; i++) {
+    taken += predictor_predict(p, s->pcs[i]);
+  }
+  sink += taken;
+  ns[MODE_PREDICT] = (sim_now() - start) * 1e9 / s->n;
+
+  predictor_destroy(p);
+}
+
+int
+compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Returns the q-quantile of the 'n' sorted values, interpolated
+// linearly between the closest ranks
+//
+double
+quantile(const double *v, int n, double q)
+{
+  double pos = q * (n - 1);
+  int lo = (int)pos;
+  if (lo >= n - 1) {
+    return v[n - 1];
+  }
+  return v[lo] + (pos - lo) * (v[lo + 1] - v[lo]);
+}
+
+// Time every predictor on every stream. The runs go round robin over
+// all of them so that a slow spell of the machine is spread over every
+// measurement instead of landing on one, which is what keeps the medians
+// comparable between invocations.
+//
+void
+measure(void)
+{
+  int num = num_configs * num_streams;
+  double *samples = malloc((size_t)num * MODES * runs * sizeof(double));
+  double ns[MODES];
+
+  for (int r = -warmup; r < runs; r++) {
+    for (int j = 0; j < num; j++) {
+      time_run(&configs[j / num_streams], &streams[j % num_streams], ns);
+      for (int m = 0; r >= 0 && m < MODES; m++) {
+        samples[((size_t)j * MODES + m) * runs + r] = ns[m];
+      }
+    }
+  }
+
+  rows = calloc((size_t)num * MODES, sizeof(*rows));
+  for (int j = 0; j < num; j++) {
+    const struct predictor_config *cfg = &configs[j / num_streams];
+    const struct stream *s = &streams[j % num_streams];
+    for (int m = 0; m < MODES; m++) {
+      double *v = &samples[((size_t)j * MODES + m) * runs];
+      qsort(v, runs, sizeof(double), compare_doubles);
+      struct row *row = &rows[num_rows++];
+      row->type = cfg->type;
+      sim_format_config(cfg, row->predictor, sizeof(row->predictor));
+      row->stream = s->name;
+      row->mode = m;
+      row->branches = s->n;
+      row->median = quantile(v, runs, 0.5);
+      row->p10 = quantile(v, runs, 0.1);
+      row->p90 = quantile(v, runs, 0.9);
+      row->min = v[0];
+
+      printf("%-14s %-10s %-14s %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+             predictor_types[cfg->type].name, s->name, mode_names[m], row->median,
+             row->p10, row->p90, row->min, 1e3 / row->median);
+    }
+  }
+  free(samples);
+}
+
+//------------------------------------//
+//         Results and Baseline       //
+//------------------------------------//
+
+// Returns True if Successful
+//
+int
+write_results(const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return 0;
+  }
+  fprintf(f, "predictor,stream,mode,branches,runs,median_ns,p10_ns,p90_ns,min_ns,mbranches_per_s\n");
+  for (int i = 0; i < num_rows; i++) {
+    struct row *r = &rows[i];
+    // Specs hold ':' but never ',' once formatted, so they need no quoting
+    fprintf(f, "%s,%s,%s,%zu,%d,%.3f,%.3f,%.3f,%.3f,%.3f\n", r->predictor, r->stream,
+            mode_names[r->mode], r->branches, runs, r->median, r->p10, r->p90, r->min,
+            1e3 / r->median);
+  }
+  return fclose(f) == 0;
+}
+
+// Look up every row in the CSV at 'path' written by write_results and
+// set its baseline median
+//
+// Returns True if Successful
+//
+int
+read_baseline(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return 0;
+  }
+
+  char line[1024];
+  while (fgets(line, sizeof(line), f)) {
+    char predictor[512], stream[64], mode[32];
+    double median;
+    if (sscanf(line, "%511[^,],%63[^,],%31[^,],%*u,%*d,%lf", predictor, stream, mode,
+               &median) != 4) {
+      continue;
+    }
+    for (int i = 0; i < num_rows; i++) {
+      struct row *r = &rows[i];
+      if (!strcmp(r->predictor, predictor) && !strcmp(r->stream, stream) &&
+          !strcmp(mode_names[r->mode], mode)) {
+        r->baseline = median;
+      }
+    }
+  }
+  fclose(f);
+  return 1;
+}
+
+// Print every row that has a baseline with its change, then the change
+// of each predictor in each mode as the geometric mean over the streams.
+// Single streams are too noisy to gate on, so only the means are held
+// against the tolerance.
+//
+// Returns the number of predictors slower than the tolerance allows
+//
+int
+check_baseline(void)
+{
+  int slower = 0, compared = 0;
+
+  printf("\n%-14s %-10s %-14s %9s %9s %8s\n", "Predictor", "Stream", "Mode", "Baseline",
+         "Median", "Change");
+  for (int i = 0; i < num_rows; i++) {
+    struct row *r = &rows[i];
+    if (r->baseline > 0) {
+      printf("%-14s %-10s %-14s %9.2f %9.2f %+7.1f%%\n", predictor_types[r->type].name,
+             r->stream, mode_names[r->mode], r->baseline, r->median,
+             100.0 * (r->median - r->baseline) / r->baseline);
+    }
+  }
+
+  printf("\n%-14s %-14s %7s %8s\n", "Predictor", "Mode", "Streams", "Change");
+  for (int k = 0; k < num_configs; k++) {
+    for (int m = 0; m < MODES; m++) {
+      double log_sum = 0;
+      int n = 0;
+      for (int i = 0; i < num_streams; i++) {
+        struct row *r = &rows[(k * num_streams + i) * MODES + m];
+        if (r->baseline > 0) {
+          log_sum += log(r->median / r->baseline);
+          n++;
+        }
+      }
+      if (n == 0) {
+        continue;
+      }
+      double change = 100.0 * (exp(log_sum / n) - 1);
+      int regressed = change > tolerance;
+      printf("%-14s %-14s %7d %+7.1f%%%s\n", predictor_types[configs[k].type].name,
+             mode_names[m], n, change, regressed ? "  SLOWER" : "");
+      slower += regressed;
+      compared++;
+    }
+  }
+  printf("%d of %d predictor/mode pairs slower than the baseline by more than %.1f%%\n",
+         slower, compared, tolerance);
+  return slower;
+}
+
+int
+add_config(const char *spec)
+{
+  configs = realloc(configs, (num_configs + 1) * sizeof(*configs));
+  if (!sim_parse_config(spec, &configs[num_configs])) {
+    return 0;
+  }
+  num_configs++;
+  return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *trace_list = default_traces;
+  const char *synthetic_list = default_synthetic;
+  const char *output = NULL;
+  const char *baseline = NULL;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--help")) {
+      usage();
+      exit(0);
+    } else if (!strncmp(argv[i], "--traces=", 9)) {
+      trace_list = argv[i] + 9;
+    } else if (!strncmp(argv[i], "--trace-dir=", 12)) {
+      trace_dir = argv[i] + 12;
+    } else if (!strncmp(argv[i], "--synthetic=", 12)) {
+      synthetic_list = argv[i] + 12;
+    } else if (!strncmp(argv[i], "--branches=", 11)) {
+      max_branches = strtoul(argv[i] + 11, NULL, 10);
+    } else if (!strncmp(argv[i], "--runs=", 7)) {
+      runs = atoi(argv[i] + 7);
+    } else if (!strncmp(argv[i], "--warmup=", 9)) {
+      warmup = atoi(argv[i] + 9);
+    } else if (!strncmp(argv[i], "--output=", 9)) {
+      output = argv[i] + 9;
+    } else if (!strncmp(argv[i], "--baseline=", 11)) {
+      baseline = argv[i] + 11;
+    } else if (!strncmp(argv[i], "--tolerance=", 12)) {
+      tolerance = atof(argv[i] + 12);
+    } else if (strncmp(argv[i], "--", 2) && add_config(argv[i])) {
+      continue;
+    } else {
+      fprintf(stderr, "Unrecognized argument %s\n", argv[i]);
+      usage();
+      exit(1);
+    }
+  }
+  if (runs < 1 || max_branches == 0) {
+    usage();
+    exit(1);
+  }
+
+  // Every registered type in its default configuration
+  if (num_configs == 0) {
+    for (int t = 0; t < BP_TYPES; t++) {
+      configs = realloc(configs, (num_configs + 1) * sizeof(*configs));
+      predictor_config_init(&configs[num_configs++], t);
+    }
+  }
+
+  // Decode on this thread only, the timed runs are single threaded
+  trace_set_threads(1);
+  if (!for_each_item(trace_list, load_trace) ||
+      !for_each_item(synthetic_list, make_synthetic) || num_streams == 0) {
+    exit(1);
+  }
+
+  printf("%d runs after %d warmup, up to %zu branches per stream, ns/branch\n", runs, warmup,
+         max_branches);
+  printf("%-14s %-10s %-14s %9s %9s %9s %9s %9s\n", "Predictor", "Stream", "Mode", "Median",
+         "P10", "P90", "Min", "Mbr/s");
+  measure();
+
+  if (output && !write_results(output)) {
+    return 1;
+  }
+  if (baseline) {
+    if (!read_baseline(baseline)) {
+      return 1;
+    }
+    return check_baseline() > 0;
+  }
+  return 0;
+}
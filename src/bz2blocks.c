@@ -0,0 +1,413 @@
+//========================================================//
+//  bz2blocks.c                                           //
+//  Source file for the parallel bzip2 block decoder      //
+//                                                        //
+//  Each block is rewrapped as a one-block bzip2 stream   //
+//  so libbz2 still checks its CRC                        //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <bzlib.h>
+#include "bz2blocks.h"
+
+#define BLOCK_MAGIC  0x314159265359ULL
+#define EOS_MAGIC    0x177245385090ULL
+#define MAGIC_MASK   0xffffffffffffULL
+
+// A block that fails to decode may have been cut at a false magic inside
+// its compressed data; retry it joined with up to this many followers
+#define MAX_MERGE    4
+
+// Pieces in flight per worker
+#define WINDOW_PER_WORKER 2
+
+struct candidate
+{
+  uint64_t bit;  // Bit offset of the magic
+  int eos;       // End-of-stream rather than block magic
+};
+
+struct result
+{
+  int state;     // 0 pending, 1 decoded, -1 failed
+  char *buf;
+  size_t len;
+};
+
+struct bz2_blocks
+{
+  const uint8_t *data;
+  size_t len;
+
+  struct candidate *cands;
+  size_t num_cands;
+  size_t *pieces;       // Candidate index of every block magic
+  size_t num_pieces;
+
+  pthread_t *threads;
+  int workers;
+  size_t window;
+  struct result *results;
+
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  pthread_cond_t room;
+  size_t next_piece;    // Next piece for a worker to take
+  size_t consumed;      // Next piece to hand out
+  int stop;
+
+  char *out;            // Buffer returned by the last call
+};
+
+//------------------------------------//
+//            Magic Scan              //
+//------------------------------------//
+
+struct scan_job
+{
+  const uint8_t *data;
+  size_t len;
+  size_t lo;
+  size_t hi;
+  struct candidate *found;
+  size_t num;
+  size_t cap;
+};
+
+// Find every magic starting in bytes [lo, hi)
+//
+static void *
+scan_range(void *arg)
+{
+  struct scan_job *j = arg;
+  uint64_t w = 0;
+  size_t end = j->hi + 7 < j->len ? j->hi + 7 : j->len;
+
+  for (size_t i = j->lo; i < end; i++) {
+    w = (w << 8) | j->data[i];
+    if (i < j->lo + 5) {
+      continue;
+    }
+    for (int k = 7; k >= 0; k--) {
+      uint64_t v = (w >> k) & MAGIC_MASK;
+      if (v != BLOCK_MAGIC && v != EOS_MAGIC) {
+        continue;
+      }
+      int64_t bit = (int64_t)(i + 1) * 8 - 48 - k;
+      if (bit < (int64_t)j->lo * 8 || bit >= (int64_t)j->hi * 8) {
+        continue;
+      }
+      if (j->num == j->cap) {
+        j->cap = j->cap ? j->cap * 2 : 64;
+        j->found = realloc(j->found, j->cap * sizeof(struct candidate));
+      }
+      j->found[j->num].bit = bit;
+      j->found[j->num].eos = v == EOS_MAGIC;
+      j->num++;
+    }
+  }
+  return NULL;
+}
+
+static void
+scan_file(struct bz2_blocks *b)
+{
+  int n = b->workers;
+  struct scan_job *jobs = calloc(n, sizeof(struct scan_job));
+  pthread_t *threads = calloc(n, sizeof(pthread_t));
+  size_t step = (b->len + n - 1) / n;
+
+  for (int i = 0; i < n; i++) {
+    jobs[i].data = b->data;
+    jobs[i].len = b->len;
+    jobs[i].lo = step * i < b->len ? step * i : b->len;
+    jobs[i].hi = step * (i + 1) < b->len ? step * (i + 1) : b->len;
+    pthread_create(&threads[i], NULL, scan_range, &jobs[i]);
+  }
+
+  // Ranges are in file order, so concatenating keeps candidates sorted
+  for (int i = 0; i < n; i++) {
+    pthread_join(threads[i], NULL);
+    b->cands = realloc(b->cands, (b->num_cands + jobs[i].num + 1) * sizeof(struct candidate));
+    memcpy(b->cands + b->num_cands, jobs[i].found, jobs[i].num * sizeof(struct candidate));
+    b->num_cands += jobs[i].num;
+    free(jobs[i].found);
+  }
+  free(jobs);
+  free(threads);
+
+  b->pieces = malloc((b->num_cands + 1) * sizeof(size_t));
+  for (size_t i = 0; i < b->num_cands; i++) {
+    // A block needs a following magic to end it
+    if (!b->cands[i].eos && i + 1 < b->num_cands) {
+      b->pieces[b->num_pieces++] = i;
+    }
+  }
+}
+
+//------------------------------------//
+//          Block Decoding            //
+//------------------------------------//
+
+struct bit_writer
+{
+  uint8_t *p;
+  size_t pos;
+  uint64_t acc;
+  int n;
+};
+
+static void
+put_bits(struct bit_writer *w, uint64_t v, int bits)
+{
+  while (bits > 0) {
+    int take = bits > 32 ? 32 : bits;
+    bits -= take;
+    w->acc = (w->acc << take) | ((v >> bits) & ((1ULL << take) - 1));
+    w->n += take;
+    while (w->n >= 8) {
+      w->n -= 8;
+      w->p[w->pos++] = (uint8_t)(w->acc >> w->n);
+    }
+  }
+}
+
+static uint64_t
+get_bits(const uint8_t *data, uint64_t bit, int bits)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < bits; i++, bit++) {
+    v = (v << 1) | ((data[bit >> 3] >> (7 - (bit & 7))) & 1);
+  }
+  return v;
+}
+
+// Decode the blocks between bit offsets 'start' and 'end'. 'start' must
+// be a block magic; the block CRC that follows it doubles as the stream
+// CRC of the rewrapped one-block stream.
+//
+// Returns 0 and fills 'out' on success
+//
+static int
+decode_range(const uint8_t *data, uint64_t start, uint64_t end, char **out, size_t *out_len)
+{
+  uint64_t bits = end - start;
+  size_t bytes = 4 + bits / 8 + 16;
+  uint8_t *stream = malloc(bytes);
+  struct bit_writer w = {stream, 0, 0, 0};
+
+  memcpy(stream, "BZh9", 4);
+  w.pos = 4;
+
+  // Copy the byte-misaligned block a byte at a time
+  uint64_t bit = start;
+  while (bit & 7 && bit < end) {
+    put_bits(&w, (data[bit >> 3] >> (7 - (bit & 7))) & 1, 1);
+    bit++;
+  }
+  while (bit + 8 <= end) {
+    put_bits(&w, data[bit >> 3], 8);
+    bit += 8;
+  }
+  while (bit < end) {
+    put_bits(&w, (data[bit >> 3] >> (7 - (bit & 7))) & 1, 1);
+    bit++;
+  }
+  put_bits(&w, EOS_MAGIC, 48);
+  put_bits(&w, get_bits(data, start + 48, 32), 32);
+  if (w.n > 0) {
+    put_bits(&w, 0, 8 - w.n);
+  }
+
+  bz_stream bzs;
+  memset(&bzs, 0, sizeof(bzs));
+  if (BZ2_bzDecompressInit(&bzs, 0, 0) != BZ_OK) {
+    free(stream);
+    return -1;
+  }
+  size_t cap = 1 << 20;
+  char *buf = malloc(cap);
+  bzs.next_in = (char *)stream;
+  bzs.avail_in = w.pos;
+  bzs.next_out = buf;
+  bzs.avail_out = cap;
+
+  int ret;
+  while ((ret = BZ2_bzDecompress(&bzs)) == BZ_OK) {
+    if (bzs.avail_out == 0) {
+      size_t len = cap;
+      cap *= 2;
+      buf = realloc(buf, cap);
+      bzs.next_out = buf + len;
+      bzs.avail_out = cap - len;
+    } else if (bzs.avail_in == 0) {
+      break;
+    }
+  }
+  size_t len = cap - bzs.avail_out;
+  BZ2_bzDecompressEnd(&bzs);
+  free(stream);
+
+  if (ret != BZ_STREAM_END) {
+    free(buf);
+    return -1;
+  }
+  *out = buf;
+  *out_len = len;
+  return 0;
+}
+
+static uint64_t
+piece_start(struct bz2_blocks *b, size_t p)
+{
+  return b->cands[b->pieces[p]].bit;
+}
+
+static void *
+worker_main(void *arg)
+{
+  struct bz2_blocks *b = arg;
+
+  pthread_mutex_lock(&b->lock);
+  for (;;) {
+    while (!b->stop && b->next_piece < b->num_pieces &&
+           b->next_piece >= b->consumed + b->window) {
+      pthread_cond_wait(&b->room, &b->lock);
+    }
+    if (b->stop || b->next_piece >= b->num_pieces) {
+      break;
+    }
+    size_t p = b->next_piece++;
+    pthread_mutex_unlock(&b->lock);
+
+    struct result r = {0, NULL, 0};
+    uint64_t end = b->cands[b->pieces[p] + 1].bit;
+    r.state = decode_range(b->data, piece_start(b, p), end, &r.buf, &r.len) == 0 ? 1 : -1;
+
+    pthread_mutex_lock(&b->lock);
+    b->results[p % b->window] = r;
+    pthread_cond_broadcast(&b->done);
+  }
+  pthread_mutex_unlock(&b->lock);
+  return NULL;
+}
+
+//------------------------------------//
+//       Parallel Decoder API         //
+//------------------------------------//
+
+struct bz2_blocks *
+bz2_blocks_open(const uint8_t *data, size_t len, int workers)
+{
+  if (len < 4 || memcmp(data, "BZh", 3) != 0 || workers < 1) {
+    return NULL;
+  }
+
+  struct bz2_blocks *b = calloc(1, sizeof(struct bz2_blocks));
+  b->data = data;
+  b->len = len;
+  b->workers = workers;
+  scan_file(b);
+  if (b->num_pieces == 0) {
+    bz2_blocks_close(b);
+    return NULL;
+  }
+
+  b->window = (size_t)workers * WINDOW_PER_WORKER;
+  b->results = calloc(b->window, sizeof(struct result));
+  pthread_mutex_init(&b->lock, NULL);
+  pthread_cond_init(&b->done, NULL);
+  pthread_cond_init(&b->room, NULL);
+  b->threads = calloc(workers, sizeof(pthread_t));
+  for (int i = 0; i < workers; i++) {
+    pthread_create(&b->threads[i], NULL, worker_main, b);
+  }
+  return b;
+}
+
+// Wait for piece 'p' and take its result out of the window
+//
+static struct result
+take_result(struct bz2_blocks *b, size_t p)
+{
+  pthread_mutex_lock(&b->lock);
+  while (b->results[p % b->window].state == 0) {
+    pthread_cond_wait(&b->done, &b->lock);
+  }
+  struct result r = b->results[p % b->window];
+  b->results[p % b->window].state = 0;
+  b->results[p % b->window].buf = NULL;
+  b->consumed = p + 1;
+  pthread_cond_broadcast(&b->room);
+  pthread_mutex_unlock(&b->lock);
+  return r;
+}
+
+long
+bz2_blocks_next(struct bz2_blocks *b, const char **out, const char **error)
+{
+  free(b->out);
+  b->out = NULL;
+
+  size_t p = b->consumed;
+  if (p >= b->num_pieces) {
+    return 0;
+  }
+
+  struct result r = take_result(b, p);
+  if (r.state < 0) {
+    // Retry the piece joined with the magics that follow it; pieces that
+    // start inside the joined range were false cuts and are dropped
+    size_t c = b->pieces[p];
+    int ok = 0;
+    for (int extra = 1; extra <= MAX_MERGE && c + 1 + extra < b->num_cands; extra++) {
+      uint64_t end = b->cands[c + 1 + extra].bit;
+      if (decode_range(b->data, piece_start(b, p), end, &r.buf, &r.len) == 0) {
+        while (b->consumed < b->num_pieces && piece_start(b, b->consumed) < end) {
+          struct result skip = take_result(b, b->consumed);
+          free(skip.buf);
+        }
+        ok = 1;
+        break;
+      }
+    }
+    if (!ok) {
+      *error = "corrupt bzip2 block";
+      return -1;
+    }
+  }
+
+  b->out = r.buf;
+  *out = r.buf;
+  return (long)r.len;
+}
+
+void
+bz2_blocks_close(struct bz2_blocks *b)
+{
+  if (b->threads) {
+    pthread_mutex_lock(&b->lock);
+    b->stop = 1;
+    pthread_cond_broadcast(&b->room);
+    pthread_mutex_unlock(&b->lock);
+    for (int i = 0; i < b->workers; i++) {
+      pthread_join(b->threads[i], NULL);
+    }
+    for (size_t i = 0; i < b->window; i++) {
+      free(b->results[i].buf);
+    }
+    pthread_mutex_destroy(&b->lock);
+    pthread_cond_destroy(&b->done);
+    pthread_cond_destroy(&b->room);
+  }
+  free(b->threads);
+  free(b->results);
+  free(b->out);
+  free(b->cands);
+  free(b->pieces);
+  free(b);
+}
@@ -0,0 +1,35 @@
+//========================================================//
+//  bz2blocks.h                                           //
+//  Header file for the parallel bzip2 block decoder      //
+//                                                        //
+//  bzip2 blocks are independent, so a file can be cut   //
+//  at the block magics and its blocks decompressed on a  //
+//  worker pool, then handed out again in file order      //
+//========================================================//
+
+#ifndef BZ2BLOCKS_H
+#define BZ2BLOCKS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+struct bz2_blocks;
+
+// Start decoding the bzip2 file mapped at 'data' with 'workers' threads.
+// The mapping must stay valid until bz2_blocks_close.
+//
+// Returns NULL if no blocks could be located
+//
+struct bz2_blocks *bz2_blocks_open(const uint8_t *data, size_t len, int workers);
+
+// Hand out the decompressed contents of the next block in file order.
+// The buffer stays valid until the next call.
+//
+// Returns the number of bytes, 0 at the end of the file, or -1 with
+// 'error' set if a block cannot be decoded
+//
+long bz2_blocks_next(struct bz2_blocks *b, const char **out, const char **error);
+
+void bz2_blocks_close(struct bz2_blocks *b);
+
+#endif
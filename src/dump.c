@@ -0,0 +1,219 @@
+//========================================================//
+//  dump.c                                                //
+//  Source file for binary prediction dumps               //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dump.h"
+
+// Bytes of data gathered before each write
+#define DUMP_CHUNK (1 << 20)
+
+struct dump_writer
+{
+  FILE *out;
+  struct bpd_header header;
+
+  // DUMP_BITS: predictions not yet making up a whole word
+  uint64_t word;
+  int word_bits;
+
+  // DUMP_MISPREDICTS: index of the last misprediction written
+  uint64_t last;
+
+  uint8_t chunk[DUMP_CHUNK];
+  size_t chunk_len;
+};
+
+static void
+dump_flush(struct dump_writer *w)
+{
+  fwrite(w->chunk, 1, w->chunk_len, w->out);
+  w->header.data_bytes += w->chunk_len;
+  w->chunk_len = 0;
+}
+
+// Append the low 'bytes' bytes of 'v', least significant first
+//
+static inline void
+put_bytes(struct dump_writer *w, uint64_t v, int bytes)
+{
+  if (w->chunk_len + 8 > DUMP_CHUNK) {
+    dump_flush(w);
+  }
+  for (int i = 0; i < bytes; i++) {
+    w->chunk[w->chunk_len++] = (uint8_t)(v >> (8 * i));
+  }
+}
+
+static inline void
+put_varint(struct dump_writer *w, uint64_t v)
+{
+  if (w->chunk_len + 10 > DUMP_CHUNK) {
+    dump_flush(w);
+  }
+  while (v >= 0x80) {
+    w->chunk[w->chunk_len++] = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  w->chunk[w->chunk_len++] = (uint8_t)v;
+}
+
+struct dump_writer *
+dump_open(const char *path, int format, const char *spec)
+{
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return NULL;
+  }
+
+  struct dump_writer *w = calloc(1, sizeof(struct dump_writer));
+  w->out = out;
+  w->header.format = format;
+  snprintf(w->header.predictor, sizeof(w->header.predictor), "%s", spec);
+  w->last = UINT64_MAX;
+
+  // Reserve room for the header
+  struct bpd_header h;
+  memset(&h, 0, sizeof(h));
+  fwrite(&h, sizeof(h), 1, out);
+  return w;
+}
+
+void
+dump_add(struct dump_writer *w, const uint64_t *bitmap, const uint8_t *outcomes, size_t n)
+{
+  for (size_t j = 0; j * 64 < n; j++) {
+    int bits = n - j * 64 < 64 ? (int)(n - j * 64) : 64;
+    uint64_t mask = bits < 64 ? (1ULL << bits) - 1 : ~0ULL;
+    uint64_t v = bitmap[j] & mask;
+
+    // Gather the outcomes into a word, the mispredictions are where it
+    // differs from the predictions
+    uint64_t o = 0;
+    for (int i = 0; i < bits; i++) {
+      o |= (uint64_t)(outcomes[j * 64 + i] & 1) << i;
+    }
+    uint64_t wrong = v ^ o;
+    w->header.mispredictions += __builtin_popcountll(wrong);
+
+    if (w->header.format == DUMP_MISPREDICTS) {
+      uint64_t first = w->header.branches + j * 64;
+      for (; wrong; wrong &= wrong - 1) {
+        uint64_t index = first + __builtin_ctzll(wrong);
+        put_varint(w, index - w->last);
+        w->last = index;
+      }
+      continue;
+    }
+
+    // Append the word behind the pending bits
+    w->word |= v << w->word_bits;
+    if (w->word_bits + bits >= 64) {
+      put_bytes(w, w->word, 8);
+      w->word = w->word_bits ? v >> (64 - w->word_bits) : 0;
+      w->word_bits += bits - 64;
+    } else {
+      w->word_bits += bits;
+    }
+  }
+  w->header.branches += n;
+}
+
+int
+dump_close(struct dump_writer *w)
+{
+  if (w->header.format == DUMP_BITS && w->word_bits) {
+    put_bytes(w, w->word, (w->word_bits + 7) / 8);
+  }
+  dump_flush(w);
+
+  memcpy(w->header.magic, BPD_MAGIC, 4);
+  w->header.version = BPD_VERSION;
+  int failed = ferror(w->out) || fseek(w->out, 0, SEEK_SET) != 0 ||
+               fwrite(&w->header, sizeof(w->header), 1, w->out) != 1;
+  failed |= fclose(w->out) != 0;
+  free(w);
+  return failed ? -1 : 0;
+}
+
+struct dump *
+dump_map(const char *path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct bpd_header)) {
+    fprintf(stderr, "%s: not a prediction dump\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror(path);
+    return NULL;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  struct dump *d = calloc(1, sizeof(struct dump));
+  d->map = map;
+  d->map_len = st.st_size;
+  memcpy(&d->header, map, sizeof(d->header));
+  d->data = d->map + sizeof(d->header);
+
+  const struct bpd_header *h = &d->header;
+  const char *error = NULL;
+  if (memcmp(h->magic, BPD_MAGIC, 4)) {
+    error = "not a prediction dump, or one that was not closed";
+  } else if (h->version != BPD_VERSION) {
+    error = "unsupported prediction dump version";
+  } else if (h->format != DUMP_BITS && h->format != DUMP_MISPREDICTS) {
+    error = "unknown prediction dump format";
+  } else if (h->data_bytes != d->map_len - sizeof(*h) ||
+             (h->format == DUMP_BITS && h->data_bytes != (h->branches + 7) / 8)) {
+    error = "prediction dump is truncated or corrupt";
+  }
+  if (error) {
+    fprintf(stderr, "%s: %s\n", path, error);
+    dump_unmap(d);
+    return NULL;
+  }
+  return d;
+}
+
+int
+dump_next_mispredict(const struct dump *d, size_t *pos, uint64_t *index)
+{
+  uint64_t v = 0;
+  int shift = 0;
+  while (*pos < d->header.data_bytes && shift < 64) {
+    uint8_t b = d->data[(*pos)++];
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      *index += v;
+      return 1;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+void
+dump_unmap(struct dump *d)
+{
+  munmap((void *)d->map, d->map_len);
+  free(d);
+}
@@ -0,0 +1,99 @@
+//========================================================//
+//  dump.h                                                //
+//  Header file for binary prediction dumps               //
+//========================================================//
+
+#ifndef DUMP_H
+#define DUMP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+//------------------------------------//
+//      Prediction Dump Format        //
+//------------------------------------//
+//
+// A dump (.bpd) is a header followed by the data of one of two formats:
+//
+//   DUMP_BITS         one bit per branch, the prediction, packed into
+//                     little-endian uint64_t words from the low bit up
+//   DUMP_MISPREDICTS  the index of every mispredicted branch as a LEB128
+//                     varint of its distance from the previous one (the
+//                     first counts from -1)
+//
+// The header is written last, a dump whose magic is missing was not
+// closed.
+//
+#define BPD_MAGIC   "BPD\x1a"
+#define BPD_VERSION 1
+
+#define DUMP_BITS        0
+#define DUMP_MISPREDICTS 1
+
+struct bpd_header
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t format;         // DUMP_BITS or DUMP_MISPREDICTS
+  uint32_t reserved;
+  uint64_t branches;       // Number of branches predicted
+  uint64_t mispredictions;
+  uint64_t data_bytes;     // Length of the data after the header
+  char predictor[256];     // Spec of the predictor, as by sim_format_config
+};
+
+//------------------------------------//
+//            Dump Writer             //
+//------------------------------------//
+
+struct dump_writer;
+
+// Create a dump of 'format' at 'path' for the predictor 'spec'. The file
+// must be seekable since the header is written last.
+//
+// Returns NULL and prints the reason to stderr on failure
+//
+struct dump_writer *dump_open(const char *path, int format, const char *spec);
+
+// Append a batch of 'n' branches, given the prediction bitmap filled in
+// by predictor_predict_batch and the outcomes
+//
+void dump_add(struct dump_writer *w, const uint64_t *bitmap, const uint8_t *outcomes,
+              size_t n);
+
+// Flush the data and write the header
+//
+// Returns 0 on success
+//
+int dump_close(struct dump_writer *w);
+
+//------------------------------------//
+//            Dump Reader             //
+//------------------------------------//
+
+// A dump mapped for reading
+struct dump
+{
+  struct bpd_header header;
+  const uint8_t *data;
+  const uint8_t *map;
+  size_t map_len;
+};
+
+// Map the dump at 'path' and check its header
+//
+// Returns NULL and prints the reason to stderr on failure
+//
+struct dump *dump_map(const char *path);
+
+// Decode the next mispredicted index of a DUMP_MISPREDICTS dump starting
+// at *pos, which is advanced. *index holds the previous index, or
+// UINT64_MAX before the first.
+//
+// Returns True if there was one
+//
+int dump_next_mispredict(const struct dump *d, size_t *pos, uint64_t *index);
+
+void dump_unmap(struct dump *d);
+
+#endif
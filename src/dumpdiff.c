@@ -0,0 +1,163 @@
+//========================================================//
+//  dumpdiff.c                                            //
+//  Compares two prediction dumps branch by branch        //
+//========================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dump.h"
+
+// Number of differing branches listed
+uint64_t max_listed = 10;
+
+void
+usage()
+{
+  fprintf(stderr,"Usage: dumpdiff <options> <first.bpd> <second.bpd>\n");
+  fprintf(stderr," Compares two prediction dumps of the same trace, written by\n");
+  fprintf(stderr," predictor --dump, and lists the branches where they differ\n");
+  fprintf(stderr," Options:\n");
+  fprintf(stderr," --help       Print this message\n");
+  fprintf(stderr," --max=<n>    List at most <n> branches (default %llu)\n",
+          (unsigned long long)max_listed);
+  fprintf(stderr," The exit status is 0 if the dumps agree, 1 if they differ and 2 on error\n");
+}
+
+// Compare two DUMP_BITS dumps a word at a time
+//
+// Returns the number of branches predicted differently
+//
+uint64_t
+diff_bits(const struct dump *a, const struct dump *b)
+{
+  uint64_t branches = a->header.branches;
+  uint64_t differ = 0;
+  size_t bytes = a->header.data_bytes;
+
+  for (size_t pos = 0; pos < bytes; pos += 8) {
+    // Words are little-endian, the last one may be short
+    uint64_t x = 0, y = 0;
+    size_t len = bytes - pos < 8 ? bytes - pos : 8;
+    memcpy(&x, a->data + pos, len);
+    memcpy(&y, b->data + pos, len);
+    uint64_t d = x ^ y;
+    if (!d) {
+      continue;
+    }
+    differ += __builtin_popcountll(d);
+    while (d && differ - __builtin_popcountll(d) < max_listed) {
+      int bit = __builtin_ctzll(d);
+      uint64_t index = pos * 8 + bit;
+      if (index < branches) {
+        printf("%12llu  %d %d\n", (unsigned long long)index, (int)(x >> bit) & 1,
+               (int)(y >> bit) & 1);
+      }
+      d &= d - 1;
+    }
+  }
+  return differ;
+}
+
+// Merge the mispredicted indices of two DUMP_MISPREDICTS dumps
+//
+// Returns the number of branches only one of them mispredicted
+//
+uint64_t
+diff_mispredicts(const struct dump *a, const struct dump *b)
+{
+  size_t pa = 0, pb = 0;
+  uint64_t ia = UINT64_MAX, ib = UINT64_MAX;
+  int more_a = dump_next_mispredict(a, &pa, &ia);
+  int more_b = dump_next_mispredict(b, &pb, &ib);
+  uint64_t both = 0, first_wrong = 0, second_wrong = 0;
+
+  while (more_a || more_b) {
+    if (more_a && more_b && ia == ib) {
+      both++;
+      more_a = dump_next_mispredict(a, &pa, &ia);
+      more_b = dump_next_mispredict(b, &pb, &ib);
+      continue;
+    }
+    int first = more_a && (!more_b || ia < ib);
+    if (first_wrong + second_wrong < max_listed) {
+      printf("%12llu  %s wrong\n", (unsigned long long)(first ? ia : ib),
+             first ? "first" : "second");
+    }
+    if (first) {
+      first_wrong++;
+      more_a = dump_next_mispredict(a, &pa, &ia);
+    } else {
+      second_wrong++;
+      more_b = dump_next_mispredict(b, &pb, &ib);
+    }
+  }
+
+  // Unlike --compare, which counts the branches only one got right
+  printf("\n%-12s %12s %12s %12s\n", "", "BothWrong", "FirstWrong", "SecondWrong");
+  printf("%-12s %12llu %12llu %12llu\n", "Mispredicts", (unsigned long long)both,
+         (unsigned long long)first_wrong, (unsigned long long)second_wrong);
+  return first_wrong + second_wrong;
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *paths[2];
+  int num_paths = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--help")) {
+      usage();
+      exit(0);
+    } else if (!strncmp(argv[i], "--max=", 6)) {
+      max_listed = strtoull(argv[i] + 6, NULL, 10);
+    } else if (strncmp(argv[i], "--", 2) && num_paths < 2) {
+      paths[num_paths++] = argv[i];
+    } else {
+      fprintf(stderr, "Unrecognized argument %s\n", argv[i]);
+      usage();
+      exit(2);
+    }
+  }
+  if (num_paths != 2) {
+    usage();
+    exit(2);
+  }
+
+  struct dump *d[2];
+  for (int i = 0; i < 2; i++) {
+    if (!(d[i] = dump_map(paths[i]))) {
+      exit(2);
+    }
+    const struct bpd_header *h = &d[i]->header;
+    printf("%-6s %s: %s, %llu branches, %llu mispredictions\n", i ? "second" : "first",
+           paths[i], h->predictor, (unsigned long long)h->branches,
+           (unsigned long long)h->mispredictions);
+  }
+  fflush(stdout);
+  if (d[0]->header.branches != d[1]->header.branches) {
+    fprintf(stderr, "The dumps cover different numbers of branches\n");
+    exit(2);
+  }
+  if (d[0]->header.format != d[1]->header.format) {
+    fprintf(stderr, "The dumps are in different formats\n");
+    exit(2);
+  }
+
+  uint64_t branches = d[0]->header.branches;
+  uint64_t differ;
+  printf("\n%12s  %s\n", "Branch", d[0]->header.format == DUMP_BITS ?
+         "Predictions" : "Mispredicted by");
+  if (d[0]->header.format == DUMP_BITS) {
+    differ = diff_bits(d[0], d[1]);
+  } else {
+    differ = diff_mispredicts(d[0], d[1]);
+  }
+  printf("\n%llu of %llu branches differ (%.3f%%)\n", (unsigned long long)differ,
+         (unsigned long long)branches, branches ? 100.0 * differ / branches : 0.0);
+
+  dump_unmap(d[0]);
+  dump_unmap(d[1]);
+  return differ > 0;
+}
@@ -0,0 +1,101 @@
+//========================================================//
+//  history.c                                             //
+//  Source file for the global history engine             //
+//========================================================//
+
+#include <string.h>
+#include <pthread.h>
+#include "history.h"
+#include "simd.h"
+
+void
+history_init(struct folded_history *h)
+{
+  memset(h, 0, sizeof(*h));
+}
+
+int
+history_add_fold(struct folded_history *h, int length, int width)
+{
+  if (h->folds == HISTORY_MAX_FOLDS || length < 0 || length >= HISTORY_MAX_LENGTH ||
+      width < 1 || width > 31) {
+    return -1;
+  }
+
+  int i = h->folds++;
+  h->r[i] = 0;
+  h->top[i] = width - 1;
+  h->mask[i] = (1u << width) - 1;
+  h->shift[i] = length % width;
+  h->length[i] = length;
+  return i;
+}
+
+static void
+push_scalar(struct folded_history *h, uint8_t outcome)
+{
+  const uint8_t *bits = h->bits + h->pos;
+  for (int i = 0; i < h->folds; i++) {
+    uint32_t r = h->r[i];
+    uint32_t lsb = (r >> h->top[i]) ^ outcome;
+    r = ((r << 1) & h->mask[i]) | lsb;
+    h->r[i] = r ^ ((uint32_t)bits[h->length[i]] << h->shift[i]);
+  }
+}
+
+#if HAVE_X86_SIMD
+
+// Eight folds per iteration. The outgoing outcomes are gathered with
+// 32-bit loads at byte offsets, the padding after bits[] keeps them in
+// bounds. The arrays live inside heap-allocated predictors, which are
+// only 16-byte aligned, so all loads are unaligned.
+//
+TARGET_AVX2 static void
+push_avx2(struct folded_history *h, uint8_t outcome)
+{
+  const int *bits = (const int *)(h->bits + h->pos);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i in = _mm256_set1_epi32(outcome);
+
+  for (int i = 0; i < h->folds; i += 8) {
+    __m256i r = _mm256_loadu_si256((const __m256i *)(h->r + i));
+    __m256i top = _mm256_loadu_si256((const __m256i *)(h->top + i));
+    __m256i mask = _mm256_loadu_si256((const __m256i *)(h->mask + i));
+    __m256i shift = _mm256_loadu_si256((const __m256i *)(h->shift + i));
+    __m256i length = _mm256_loadu_si256((const __m256i *)(h->length + i));
+
+    __m256i lsb = _mm256_xor_si256(_mm256_srlv_epi32(r, top), in);
+    r = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(r, 1), mask), lsb);
+    __m256i out = _mm256_and_si256(_mm256_i32gather_epi32(bits, length, 1), one);
+    r = _mm256_xor_si256(r, _mm256_sllv_epi32(out, shift));
+
+    _mm256_storeu_si256((__m256i *)(h->r + i), r);
+  }
+}
+
+#endif
+
+static void (*push_folds)(struct folded_history *h, uint8_t outcome) = push_scalar;
+static pthread_once_t history_once = PTHREAD_ONCE_INIT;
+
+static void
+history_dispatch(void)
+{
+#if HAVE_X86_SIMD
+  if (cpu_has_avx2()) {
+    push_folds = push_avx2;
+  }
+#endif
+}
+
+void
+history_push(struct folded_history *h, uint8_t outcome)
+{
+  pthread_once(&history_once, history_dispatch);
+
+  h->pos = (h->pos - 1) & (HISTORY_MAX_LENGTH - 1);
+  h->bits[h->pos] = outcome;
+  h->bits[h->pos + HISTORY_MAX_LENGTH] = outcome;
+
+  push_folds(h, outcome);
+}
@@ -0,0 +1,58 @@
+//========================================================//
+//  history.h                                             //
+//  Header file for the global history engine             //
+//                                                        //
+//  Keeps the global branch history in a circular buffer  //
+//  and updates any number of folded (circular shift)     //
+//  copies of its prefixes, all in one pass per branch    //
+//========================================================//
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+// Longest history that can be folded, a power of two
+#define HISTORY_MAX_LENGTH 256
+
+// Most folded registers per history, a multiple of the vector width
+#define HISTORY_MAX_FOLDS 32
+
+struct folded_history
+{
+  // Fold i compresses the newest length[i] outcomes into width[i] bits.
+  // The parameters are kept in separate arrays so the update can load
+  // them a vector of folds at a time.
+  uint32_t r[HISTORY_MAX_FOLDS];
+  uint32_t top[HISTORY_MAX_FOLDS];    // width - 1
+  uint32_t mask[HISTORY_MAX_FOLDS];   // 2^width - 1
+  uint32_t shift[HISTORY_MAX_FOLDS];  // length % width
+  uint32_t length[HISTORY_MAX_FOLDS];
+  int folds;
+
+  // The outcome pushed 'age' branches ago is bits[pos + age]. Each
+  // outcome is stored twice, HISTORY_MAX_LENGTH apart, so reading any
+  // age below HISTORY_MAX_LENGTH never wraps.
+  uint32_t pos;
+  uint8_t bits[2 * HISTORY_MAX_LENGTH + 4];
+};
+
+// Start an empty history with no folds
+//
+void history_init(struct folded_history *h);
+
+// Add a register folding the newest 'length' outcomes into 'width' bits
+//
+// Returns the index of the fold, or -1 if there is no room or the
+// length or width is out of range
+//
+int history_add_fold(struct folded_history *h, int length, int width);
+
+// Push the outcome of the latest branch and update every fold.
+// A fold rotates left by one with the new outcome XORed into bit 0 and
+// the outcome that just reached age 'length' XORed in at bit
+// length % width.
+//
+void history_push(struct folded_history *h, uint8_t outcome);
+
+#endif
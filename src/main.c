@@ -8,11 +8,73 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "dump.h"
+#include "perfstat.h"
 #include "predictor.h"
+#include "profile.h"
+#include "sim.h"
+#include "trace.h"
 
-FILE *stream;
-char *buf = NULL;
-size_t len = 0;
+struct trace *trace;
+
+// Predictor selected with --<type>
+struct predictor_config config;
+
+// Predictors evaluated side by side with --compare. A type may be listed
+// more than once with different parameters. run_compare counts the
+// branches per set of predictors that got them right, 2^MAX_COMPARE sets.
+#define MAX_COMPARE 8
+struct predictor_config compare_configs[MAX_COMPARE];
+char compare_names[MAX_COMPARE][32];
+int num_compare = 0;
+
+// Per-branch profile printed after the statistics with --profile
+int profile_top = 0;
+int profile_format = PROFILE_CSV;
+
+// Phase timing with --perf, split into predict and train per branch
+// with --perf=split
+#define PHASE_TRACE    0
+#define PHASE_BATCH    1
+#define PHASE_PREDICT  2
+#define PHASE_TRAIN    3
+#define MAX_PHASES     8
+int perf = 0;
+int perf_split = 0;
+struct perf_counters counters;
+struct perf_phase phases[MAX_PHASES] = {
+  {"trace_next"}, {"predict+train"}, {"  predict (TSC)"}, {"  train (TSC)"}
+};
+
+// Statistics of every window of 'interval' branches with --interval,
+// with the share and accuracy of each provider with
+// --interval-providers
+#define INTERVAL_CSV   0
+#define INTERVAL_JSON  1
+uint64_t interval = 0;
+int interval_format = INTERVAL_CSV;
+int interval_providers = 0;
+const char *interval_path = NULL;
+FILE *interval_out;
+
+struct window
+{
+  uint64_t index;
+  uint64_t first;                           // Trace position of its first branch
+  uint64_t branches;
+  uint64_t mispredictions;
+  uint64_t uses[PROFILE_PROVIDERS];         // Per provider + 1
+  uint64_t correct[PROFILE_PROVIDERS];
+} window;
+
+// Binary dump of the predictions with --dump
+const char *dump_path = NULL;
+int dump_format = DUMP_BITS;
+
+// Progress line on stderr every progress_interval seconds with --progress
+double progress_interval = 0;
+double progress_start;
+double progress_last;
 
 // Print out the Usage information to stderr
 //
@@ -21,17 +83,86 @@ usage()
 {
   fprintf(stderr,"Usage: predictor <options> [<trace>]\n");
   fprintf(stderr,"       bunzip -kc trace.bz2 | predictor <options>\n");
+  fprintf(stderr,"       predictor <options> trace.bz2|trace.bpt\n");
   fprintf(stderr," Options:\n");
   fprintf(stderr," --help       Print this message\n");
   fprintf(stderr," --verbose    Print predictions on stdout\n");
-  fprintf(stderr," --<type>     Branch prediction scheme:\n");
+  fprintf(stderr," --threads=<n> Threads for decompressing bzip2 traces\n");
+  fprintf(stderr," --profile[=<n>]\n"
+                 "              Print the <n> (default 20) branches with the most\n"
+                 "              mispredictions, 0 for all of them\n");
+  fprintf(stderr," --profile-format=csv|json\n"
+                 "              Format of the --profile output (default csv)\n");
+  fprintf(stderr," --perf[=split]\n"
+                 "              Report time, IPC and cache and branch misses of the\n"
+                 "              trace reader and the predictor on stderr. With split,\n"
+                 "              prediction and training are also timed per branch\n");
+  fprintf(stderr," --progress[=<s>]\n"
+                 "              Print the branches done, their rate and the mispredict\n"
+                 "              rate so far on stderr every <s> (default 1) seconds\n");
+  fprintf(stderr," --dump=<file>\n"
+                 "              Write the predictions to a binary dump for dumpdiff\n");
+  fprintf(stderr," --dump-format=bits|mispredicts\n"
+                 "              One bit per prediction, or the indices of the\n"
+                 "              mispredicted branches (default bits)\n");
+  fprintf(stderr," --interval=<n>\n"
+                 "              Write the mispredictions, accuracy and MPKI of every\n"
+                 "              <n> branches before the statistics\n");
+  fprintf(stderr," --interval-format=csv|json\n"
+                 "              CSV or one JSON object per line (default csv)\n");
+  fprintf(stderr," --interval-output=<file>\n"
+                 "              Write the intervals to <file> instead of stdout\n");
+  fprintf(stderr," --interval-providers\n"
+                 "              Add how often each table (TAGE component, tournament\n"
+                 "              choice, ...) provided the prediction and its accuracy.\n"
+                 "              This runs every branch through predictor_lookup\n");
+  fprintf(stderr," --compare=<type>,<type>,...\n"
+                 "              Run up to %d schemes over one pass of the trace\n", MAX_COMPARE);
+  fprintf(stderr," --<type>, --predictor=<type>\n"
+                 "              Branch prediction scheme:\n");
   fprintf(stderr,"    static\n"
                  "    gshare:<# ghistory>\n"
-                 "    tournament:<# ghistory>:<# lhistory>:<# index>\n"
-                 "    custom\n");
+                 "    tournament:<# ghistory>:<# lhistory>:<# index>:<# choice>\n"
+                 "    custom\n"
+                 "    tage\n"
+                 "    bimode\n"
+                 "    perceptron:<# history>:<# index>\n");
+  fprintf(stderr," Parameters may be given by name, e.g. --tournament:lIndexBits=11\n"
+                 " or --predictor=tage:tag_bit=10,L7=120\n");
 }
 
 
+// Parse the comma separated type list of --compare
+//
+// Returns True if Successful
+//
+int
+parse_compare(const char *list)
+{
+  while (*list) {
+    size_t len = sim_spec_length(list);
+    char spec[sizeof(compare_names[0])];
+    if (num_compare == MAX_COMPARE) {
+      fprintf(stderr, "--compare takes at most %d predictors\n", MAX_COMPARE);
+      return 0;
+    }
+    if (len >= sizeof(spec)) {
+      return 0;
+    }
+    snprintf(spec, sizeof(spec), "%.*s", (int)len, list);
+    if (!sim_parse_config(spec, &compare_configs[num_compare])) {
+      return 0;
+    }
+    // Name a bare type like the predictor, keep the spec otherwise
+    int type = compare_configs[num_compare].type;
+    snprintf(compare_names[num_compare], sizeof(spec), "%s",
+             strchr(spec, ':') ? spec : predictor_types[type].name);
+    num_compare++;
+    list += len + (list[len] == ',');
+  }
+  return num_compare > 0;
+}
+
 // Process an option and update the predictor
 // configuration variables accordingly
 //
@@ -40,16 +171,54 @@ usage()
 int
 handle_option(char *arg)
 {
-  if (!strcmp(arg,"--static")) {
-    bpType = STATIC;
-  } else if (!strncmp(arg,"--gshare",8)) {
-    bpType = GSHARE;
-  } else if (!strncmp(arg,"--tournament",12)) {
-    bpType = TOURNAMENT;
-  } else if (!strncmp(arg,"--custom",8)) {
-    bpType = CUSTOM;
+  if (sim_parse_config(arg + 2, &config)) {
+    bpType = config.type;
+  } else if (!strncmp(arg,"--predictor=",12)) {
+    if (!sim_parse_config(arg + 12, &config)) {
+      return 0;
+    }
+    bpType = config.type;
   } else if (!strcmp(arg,"--verbose")) {
     verbose = 1;
+  } else if (!strncmp(arg,"--compare=",10)) {
+    return parse_compare(arg + 10);
+  } else if (!strncmp(arg,"--threads=",10)) {
+    trace_set_threads(atoi(arg + 10));
+  } else if (!strcmp(arg,"--profile")) {
+    profile_top = 20;
+  } else if (!strncmp(arg,"--profile=",10)) {
+    // Any count below 1 prints every branch
+    profile_top = atoi(arg + 10) > 0 ? atoi(arg + 10) : -1;
+  } else if (!strcmp(arg,"--profile-format=csv")) {
+    profile_format = PROFILE_CSV;
+  } else if (!strcmp(arg,"--profile-format=json")) {
+    profile_format = PROFILE_JSON;
+  } else if (!strcmp(arg,"--perf")) {
+    perf = 1;
+  } else if (!strcmp(arg,"--perf=split")) {
+    perf = perf_split = 1;
+  } else if (!strncmp(arg,"--dump=",7)) {
+    dump_path = arg + 7;
+  } else if (!strcmp(arg,"--dump-format=bits")) {
+    dump_format = DUMP_BITS;
+  } else if (!strcmp(arg,"--dump-format=mispredicts")) {
+    dump_format = DUMP_MISPREDICTS;
+  } else if (!strncmp(arg,"--interval=",11)) {
+    interval = strtoull(arg + 11, NULL, 10);
+    return interval > 0;
+  } else if (!strcmp(arg,"--interval-format=csv")) {
+    interval_format = INTERVAL_CSV;
+  } else if (!strcmp(arg,"--interval-format=json")) {
+    interval_format = INTERVAL_JSON;
+  } else if (!strncmp(arg,"--interval-output=",18)) {
+    interval_path = arg + 18;
+  } else if (!strcmp(arg,"--interval-providers")) {
+    interval_providers = 1;
+  } else if (!strcmp(arg,"--progress")) {
+    progress_interval = 1;
+  } else if (!strncmp(arg,"--progress=",11)) {
+    progress_interval = atof(arg + 11);
+    return progress_interval > 0;
   } else {
     return 0;
   }
@@ -57,30 +226,277 @@ handle_option(char *arg)
   return 1;
 }
 
-// Reads a line from the input stream and extracts the
-// PC and Outcome of a branch
+// trace_next, timed with --perf
+//
+size_t
+next_batch(const uint32_t **pcs, const uint8_t **outcomes)
+{
+  if (!perf) {
+    return trace_next(trace, pcs, outcomes);
+  }
+  struct perf_sample sample;
+  perf_begin(&counters, &sample);
+  size_t n = trace_next(trace, pcs, outcomes);
+  perf_end(&counters, &phases[PHASE_TRACE], &sample);
+  return n;
+}
+
+// Predict and train on one batch like predictor_profile_batch. With
+// --perf=split or --interval-providers the branches go through
+// predictor_lookup and predictor_update one at a time, so that each can
+// be timed and its provider counted. The counters are still only read
+// around the whole batch.
+//
+// Returns the number of mispredictions
+//
+uint32_t
+run_batch(struct predictor *p, const uint32_t *pcs, const uint8_t *outcomes, size_t n,
+          uint64_t *bitmap, struct profile *profile)
+{
+  if (!perf && !interval_providers) {
+    return predictor_profile_batch(p, pcs, outcomes, n, bitmap, profile);
+  }
+
+  struct perf_sample sample;
+  uint32_t wrong = 0;
+  if (perf) {
+    perf_begin(&counters, &sample);
+  }
+  if (!perf_split && !interval_providers) {
+    wrong = predictor_profile_batch(p, pcs, outcomes, n, bitmap, profile);
+  } else {
+    if (bitmap) {
+      memset(bitmap, 0, (n + 63) / 64 * sizeof(uint64_t));
+    }
+    for (size_t i = 0; i < n; i++) {
+      struct predictor_token l;
+      uint8_t prediction;
+      if (perf_split) {
+        uint64_t start = perf_ticks();
+        prediction = predictor_lookup(p, pcs[i], &l);
+        perf_end_ticks(&phases[PHASE_PREDICT], start);
+
+        start = perf_ticks();
+        predictor_update(p, pcs[i], outcomes[i], &l);
+        perf_end_ticks(&phases[PHASE_TRAIN], start);
+      } else {
+        prediction = predictor_lookup(p, pcs[i], &l);
+        predictor_update(p, pcs[i], outcomes[i], &l);
+      }
+
+      if (profile) {
+        profile_count(profile, pcs[i], outcomes[i], prediction, l.provider);
+      }
+      if (bitmap) {
+        bitmap[i >> 6] |= (uint64_t)prediction << (i & 63);
+      }
+      window.uses[l.provider + 1]++;
+      window.correct[l.provider + 1] += prediction == outcomes[i];
+      wrong += prediction != outcomes[i];
+    }
+  }
+  if (perf) {
+    perf_end(&counters, &phases[PHASE_BATCH], &sample);
+  }
+  return wrong;
+}
+
+// Write the statistics of the current window and start the next one
+//
+void
+write_window(void)
+{
+  struct window *w = &window;
+  double accuracy = 100.0 * (w->branches - w->mispredictions) / w->branches;
+  double mpki = 1000.0 * w->mispredictions / w->branches;
+  const char *const *names = predictor_types[config.type].providers;
+
+  if (interval_format == INTERVAL_JSON) {
+    fprintf(interval_out, "{\"window\": %llu, \"first\": %llu, \"branches\": %llu, "
+                          "\"mispredictions\": %llu, \"accuracy\": %.3f, \"mpki\": %.3f",
+            (unsigned long long)w->index, (unsigned long long)w->first,
+            (unsigned long long)w->branches, (unsigned long long)w->mispredictions,
+            accuracy, mpki);
+    if (interval_providers) {
+      fprintf(interval_out, ", \"providers\": {");
+      for (int k = 0, first = 1; k < PROFILE_PROVIDERS; k++) {
+        if (names[k]) {
+          fprintf(interval_out, "%s\"%s\": {\"share\": %.3f, \"accuracy\": %.3f}",
+                  first ? "" : ", ", names[k], 100.0 * w->uses[k] / w->branches,
+                  w->uses[k] ? 100.0 * w->correct[k] / w->uses[k] : 0.0);
+          first = 0;
+        }
+      }
+      fprintf(interval_out, "}");
+    }
+    fprintf(interval_out, "}\n");
+  } else {
+    if (w->index == 0) {
+      fprintf(interval_out, "window,first,branches,mispredictions,accuracy,mpki");
+      for (int k = 0; interval_providers && k < PROFILE_PROVIDERS; k++) {
+        if (names[k]) {
+          fprintf(interval_out, ",%s_share,%s_accuracy", names[k], names[k]);
+        }
+      }
+      fprintf(interval_out, "\n");
+    }
+    fprintf(interval_out, "%llu,%llu,%llu,%llu,%.3f,%.3f", (unsigned long long)w->index,
+            (unsigned long long)w->first, (unsigned long long)w->branches,
+            (unsigned long long)w->mispredictions, accuracy, mpki);
+    for (int k = 0; interval_providers && k < PROFILE_PROVIDERS; k++) {
+      if (names[k]) {
+        fprintf(interval_out, ",%.3f,%.3f", 100.0 * w->uses[k] / w->branches,
+                w->uses[k] ? 100.0 * w->correct[k] / w->uses[k] : 0.0);
+      }
+    }
+    fprintf(interval_out, "\n");
+  }
+
+  uint64_t next = w->first + w->branches;
+  memset(w, 0, sizeof(*w));
+  w->index = next / interval;
+  w->first = next;
+}
+
+// Print a progress line if progress_interval has passed since the last
+// one. 'mispredictions' is NULL when there is no single rate to show.
+//
+void
+report_progress(uint64_t branches, const uint64_t *mispredictions)
+{
+  double now = sim_now();
+  if (now - progress_last < progress_interval) {
+    return;
+  }
+  progress_last = now;
+
+  double elapsed = now - progress_start;
+  fprintf(stderr, "[%8.1fs] %14llu branches %9.2f Mbr/s", elapsed,
+          (unsigned long long)branches, branches / elapsed * 1e-6);
+  if (mispredictions) {
+    fprintf(stderr, "  Misprediction Rate: %7.3f", 100.0 * *mispredictions / branches);
+  }
+  fprintf(stderr, "\n");
+}
+
+// Print the phases of the main loop and of the trace reader
 //
-// Returns True if Successful 
+void
+report_phases(uint64_t branches)
+{
+  int num = perf_split ? PHASE_TRAIN + 1 : PHASE_BATCH + 1;
+  int num_trace;
+  const struct perf_phase *trace_phases = trace_perf_phases(trace, &num_trace);
+  for (int i = 0; i < num_trace && num < MAX_PHASES; i++) {
+    phases[num++] = trace_phases[i];
+  }
+
+  // Keep the report after the statistics when both go to one file
+  fflush(stdout);
+  fprintf(stderr, "\n");
+  if (!counters.num) {
+    fprintf(stderr, "Hardware counters unavailable, timing with the TSC only\n");
+  }
+  perf_report(stderr, phases, num, branches);
+}
+
+// Run every predictor in compare_types over the trace in one pass and
+// report their results along with how often each pair agrees
 //
 int
-read_branch(uint32_t *pc, uint8_t *outcome)
+run_compare()
 {
-  if (getline(&buf, &len, stream) == -1) {
-    return 0;
+  uint64_t num_branches = 0;
+  uint64_t mispredictions[MAX_COMPARE] = {0};
+
+  // Branch count per set of predictors that got the branch right
+  uint64_t correct_sets[1 << MAX_COMPARE] = {0};
+
+  struct predictor *predictors[MAX_COMPARE];
+  for (int k = 0; k < num_compare; k++) {
+    predictors[k] = predictor_create(&compare_configs[k]);
   }
 
-  uint32_t tmp;
-  sscanf(buf,"0x%x %d\n",pc,&tmp);
-  *outcome = tmp;
+  const uint32_t *pcs;
+  const uint8_t *outcomes;
+  size_t n;
 
-  return 1;
+  // Each predictor runs a whole batch at a time, the per-branch
+  // results are then combined from their prediction bitmaps
+  uint64_t bitmaps[MAX_COMPARE][TRACE_BATCH / 64];
+
+  while ((n = trace_next(trace, &pcs, &outcomes)) > 0) {
+    for (int k = 0; k < num_compare; k++) {
+      predictor_predict_batch(predictors[k], pcs, outcomes, n, bitmaps[k]);
+    }
+    for (size_t i = 0; i < n; i++) {
+      uint8_t outcome = outcomes[i];
+      unsigned correct = 0;
+      num_branches++;
+
+      for (int k = 0; k < num_compare; k++) {
+        uint8_t prediction = (bitmaps[k][i >> 6] >> (i & 63)) & 1;
+        correct |= (unsigned)(prediction == outcome) << k;
+      }
+      correct_sets[correct]++;
+    }
+    if (progress_interval > 0) {
+      report_progress(num_branches, NULL);
+    }
+  }
+  if (trace_error(trace)) {
+    fprintf(stderr, "Error reading trace: %s\n", trace_error(trace));
+    exit(1);
+  }
+  trace_close(trace);
+  for (int k = 0; k < num_compare; k++) {
+    predictor_destroy(predictors[k]);
+  }
+
+  for (unsigned set = 0; set < (1u << num_compare); set++) {
+    for (int k = 0; k < num_compare; k++) {
+      if (!(set & (1u << k))) {
+        mispredictions[k] += correct_sets[set];
+      }
+    }
+  }
+
+  printf("Branches:        %10llu\n", (unsigned long long)num_branches);
+  printf("%-12s %10s %10s\n", "Predictor", "Incorrect", "Rate");
+  for (int k = 0; k < num_compare; k++) {
+    double mispredict_rate = 100*((double)mispredictions[k] / (double)num_branches);
+    printf("%-12s %10llu %10.3f\n", compare_names[k], (unsigned long long)mispredictions[k],
+           mispredict_rate);
+  }
+
+  // With binary outcomes two predictors that disagree have exactly one
+  // of them right
+  printf("\n%-24s %10s %10s %10s %10s %10s\n", "Pair", "Agree", "BothWrong",
+         "Disagree", "FirstOnly", "SecondOnly");
+  for (int a = 0; a < num_compare; a++) {
+    for (int b = a + 1; b < num_compare; b++) {
+      uint64_t count[4] = {0};
+      for (unsigned set = 0; set < (1u << num_compare); set++) {
+        count[((set >> a) & 1) | ((set >> b) & 1) << 1] += correct_sets[set];
+      }
+      char pair[2 * sizeof(compare_names[0])];
+      snprintf(pair, sizeof(pair), "%s/%s", compare_names[a], compare_names[b]);
+      printf("%-24s %10llu %10llu %10llu %10llu %10llu\n", pair,
+             (unsigned long long)(count[0] + count[3]), (unsigned long long)count[0],
+             (unsigned long long)(count[1] + count[2]), (unsigned long long)count[1],
+             (unsigned long long)count[2]);
+    }
+  }
+
+  return 0;
 }
 
 int
 main(int argc, char *argv[])
 {
   // Set defaults
-  stream = stdin;
+  char *trace_path = NULL;
+  predictor_config_init(&config, STATIC);
   bpType = STATIC;
   verbose = 0;
 
@@ -97,44 +513,151 @@ main(int argc, char *argv[])
       }
     } else {
       // Use as input file
-      stream = fopen(argv[i], "r");
+      trace_path = argv[i];
+    }
+  }
+
+  // --compare only reports the mispredictions and agreement of each
+  // predictor, the options that report on a single one do not apply
+  if (num_compare > 0) {
+    const char *single = interval ? "--interval" :
+                         interval_providers ? "--interval-providers" :
+                         perf ? "--perf" :
+                         profile_top ? "--profile" :
+                         dump_path ? "--dump" :
+                         verbose ? "--verbose" : NULL;
+    if (single) {
+      fprintf(stderr, "%s takes a single predictor, not --compare\n", single);
+      exit(1);
     }
   }
 
+  if (interval_providers && !interval) {
+    fprintf(stderr, "--interval-providers needs --interval\n");
+    exit(1);
+  }
+
+  if (perf) {
+    perf_start();
+    perf_open(&counters);
+    trace_set_perf(1);
+  }
+
+  trace = trace_open(trace_path);
+  if (!trace) {
+    exit(1);
+  }
+  progress_start = progress_last = sim_now();
+
+  if (num_compare > 0) {
+    return run_compare();
+  }
+
   // Initialize the predictor
-  init_predictor();
+  struct predictor *predictor = predictor_create(&config);
+
+  uint64_t num_branches = 0;
+  uint64_t mispredictions = 0;
+  const uint32_t *pcs;
+  const uint8_t *outcomes;
+  size_t n;
+
+  // Predictions are only kept for --verbose and --dump
+  uint64_t bitmap[TRACE_BATCH / 64];
+  char lines[2 * TRACE_BATCH];
+  struct profile *profile = profile_top ? profile_create(config.type) : NULL;
+
+  struct dump_writer *dump = NULL;
+  if (dump_path) {
+    char spec[sizeof(((struct bpd_header *)0)->predictor)];
+    sim_format_config(&config, spec, sizeof(spec));
+    if (!(dump = dump_open(dump_path, dump_format, spec))) {
+      exit(1);
+    }
+  }
 
-  uint32_t num_branches = 0;
-  uint32_t mispredictions = 0;
-  uint32_t pc = 0;
-  uint8_t outcome = NOTTAKEN;
+  if (interval) {
+    interval_out = interval_path ? fopen(interval_path, "w") : stdout;
+    if (!interval_out) {
+      perror(interval_path);
+      exit(1);
+    }
+    // Windows are written as they complete, in large blocks
+    setvbuf(interval_out, NULL, _IOFBF, 1 << 20);
+  }
 
-  // Reach each branch from the trace
-  while (read_branch(&pc, &outcome)) {
-    num_branches++;
+  // Reach each batch of branches from the trace
+  while ((n = next_batch(&pcs, &outcomes)) > 0) {
+    // With --interval a batch is cut where a window ends
+    for (size_t i = 0, k; i < n; i += k) {
+      k = interval && interval - window.branches < n - i ? interval - window.branches : n - i;
 
-    // Make a prediction and compare with actual outcome
-    uint8_t prediction = make_prediction(pc);
-    if (prediction != outcome) {
-      mispredictions++;
+      // Make the predictions, compare them with the actual outcomes and
+      // train the predictor
+      uint32_t wrong = run_batch(predictor, pcs + i, outcomes + i, k,
+                                 verbose || dump ? bitmap : NULL, profile);
+      if (verbose != 0) {
+        for (size_t j = 0; j < k; j++) {
+          lines[2 * j] = '0' + ((bitmap[j >> 6] >> (j & 63)) & 1);
+          lines[2 * j + 1] = '\n';
+        }
+        fwrite(lines, 2, k, stdout);
+      }
+      if (dump) {
+        dump_add(dump, bitmap, outcomes + i, k);
+      }
+      num_branches += k;
+      mispredictions += wrong;
+      window.branches += k;
+      window.mispredictions += wrong;
+      if (window.branches == interval) {
+        write_window();
+      }
     }
-    if (verbose != 0) {
-      printf ("%d\n", prediction);
+    if (progress_interval > 0) {
+      report_progress(num_branches, &mispredictions);
     }
+  }
+  if (trace_error(trace)) {
+    fprintf(stderr, "Error reading trace: %s\n", trace_error(trace));
+    exit(1);
+  }
 
-    // Train the predictor
-    train_predictor(pc, outcome);
+  if (dump && dump_close(dump) != 0) {
+    fprintf(stderr, "%s: write failed\n", dump_path);
+    exit(1);
+  }
+
+  if (interval) {
+    if (window.branches) {
+      write_window();
+    }
+    if (interval_out != stdout) {
+      fclose(interval_out);
+    } else {
+      printf("\n");
+    }
   }
 
   // Print out the mispredict statistics
-  printf("Branches:        %10d\n", num_branches);
-  printf("Incorrect:       %10d\n", mispredictions);
-  float mispredict_rate = 100*((float)mispredictions / (float)num_branches);
+  printf("Branches:        %10llu\n", (unsigned long long)num_branches);
+  printf("Incorrect:       %10llu\n", (unsigned long long)mispredictions);
+  double mispredict_rate = 100*((double)mispredictions / (double)num_branches);
   printf("Misprediction Rate: %7.3f\n", mispredict_rate);
 
+  if (profile) {
+    printf("\n");
+    profile_write(profile, stdout, profile_top, profile_format);
+    profile_destroy(profile);
+  }
+  if (perf) {
+    report_phases(num_branches);
+    perf_close(&counters);
+  }
+
   // Cleanup
-  fclose(stream);
-  free(buf);
+  trace_close(trace);
+  predictor_destroy(predictor);
 
   return 0;
 }
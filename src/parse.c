@@ -0,0 +1,251 @@
+//========================================================//
+//  parse.c                                               //
+//  Source file for the bulk text trace parser            //
+//                                                        //
+//  Newlines are located 64 bytes at a time with vector   //
+//  compares and each line's hex digits are classified    //
+//  and packed in one register. A scalar path handles     //
+//  other CPUs and any line off the common shape.         //
+//========================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "parse.h"
+#include "simd.h"
+
+static uint8_t hexval[256];
+
+//------------------------------------//
+//           Scalar Kernels           //
+//------------------------------------//
+
+static inline uint64_t
+newline_mask_scalar(const char *p)
+{
+  uint64_t m = 0;
+  for (int i = 0; i < 64; i++) {
+    m |= (uint64_t)(p[i] == '\n') << i;
+  }
+  return m;
+}
+
+// Decode 'n' hex digits at 'p'
+//
+// Returns 0 if any of them is not a hex digit
+//
+static inline int
+hex_scalar(const char *p, int n, uint32_t *pc)
+{
+  uint32_t v = 0;
+  uint8_t bad = 0;
+  for (int i = 0; i < n; i++) {
+    uint8_t d = hexval[(uint8_t)p[i]];
+    bad |= d;
+    v = (v << 4) | (d & 0xf);
+  }
+  *pc = v;
+  return !(bad & 0x80);
+}
+
+//------------------------------------//
+//           Vector Kernels           //
+//------------------------------------//
+
+#if HAVE_X86_SIMD
+
+static inline uint64_t
+newline_mask_sse2(const char *p)
+{
+  const __m128i nl = _mm_set1_epi8('\n');
+  uint64_t m = 0;
+  for (int i = 0; i < 4; i++) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+    m |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) << (16 * i);
+  }
+  return m;
+}
+
+TARGET_AVX2 static inline uint64_t
+newline_mask_avx2(const char *p)
+{
+  const __m256i nl = _mm256_set1_epi8('\n');
+  __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+  __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+  uint32_t mlo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, nl));
+  uint32_t mhi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, nl));
+  return (uint64_t)mhi << 32 | mlo;
+}
+
+// Right-align 'n' digit values into lanes 0..7, zeroing the rest
+static const int8_t hex_shuffle[9][16] = {
+#define Z -128
+  {Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z},
+  {Z, Z, Z, Z, Z, Z, Z, 0, Z, Z, Z, Z, Z, Z, Z, Z},
+  {Z, Z, Z, Z, Z, Z, 0, 1, Z, Z, Z, Z, Z, Z, Z, Z},
+  {Z, Z, Z, Z, Z, 0, 1, 2, Z, Z, Z, Z, Z, Z, Z, Z},
+  {Z, Z, Z, Z, 0, 1, 2, 3, Z, Z, Z, Z, Z, Z, Z, Z},
+  {Z, Z, Z, 0, 1, 2, 3, 4, Z, Z, Z, Z, Z, Z, Z, Z},
+  {Z, Z, 0, 1, 2, 3, 4, 5, Z, Z, Z, Z, Z, Z, Z, Z},
+  {Z, 0, 1, 2, 3, 4, 5, 6, Z, Z, Z, Z, Z, Z, Z, Z},
+  {0, 1, 2, 3, 4, 5, 6, 7, Z, Z, Z, Z, Z, Z, Z, Z},
+#undef Z
+};
+
+// Classify 16 bytes as decimal or hex letter, convert them to nibbles
+// and pack the first 'n' (at most 8) into a 32-bit PC
+//
+TARGET_SSSE3 static inline int
+hex_ssse3(const char *p, int n, uint32_t *pc)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *)p);
+  __m128i dig = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+  __m128i alp = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  __m128i is_dig = _mm_cmpeq_epi8(_mm_min_epu8(dig, _mm_set1_epi8(9)), dig);
+  __m128i is_alp = _mm_cmpeq_epi8(_mm_min_epu8(alp, _mm_set1_epi8(5)), alp);
+  unsigned mask = _mm_movemask_epi8(_mm_or_si128(is_dig, is_alp));
+  unsigned want = (1u << n) - 1;
+
+  __m128i val = _mm_or_si128(_mm_and_si128(is_dig, dig),
+                             _mm_and_si128(is_alp, _mm_add_epi8(alp, _mm_set1_epi8(10))));
+  val = _mm_shuffle_epi8(val, _mm_loadu_si128((const __m128i *)hex_shuffle[n]));
+  val = _mm_maddubs_epi16(val, _mm_set1_epi16(0x0110));
+  val = _mm_packus_epi16(val, val);
+  *pc = __builtin_bswap32((uint32_t)_mm_cvtsi128_si32(val));
+  return (mask & want) == want;
+}
+
+#endif
+
+//------------------------------------//
+//            Line Parser             //
+//------------------------------------//
+
+// Parse a line off the common shape: "0x", 1-8 hex digits, blanks, the
+// outcome and optional trailing blanks or '\r'
+//
+static int
+parse_line_slow(const char *p, size_t len, uint32_t *pc, uint8_t *outcome)
+{
+  while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t' || p[len - 1] == '\r')) {
+    len--;
+  }
+  if (len < 5 || p[0] != '0' || (p[1] | 0x20) != 'x') {
+    return 0;
+  }
+  size_t n = 2;
+  while (n < len && !(hexval[(uint8_t)p[n]] & 0x80)) {
+    n++;
+  }
+  size_t digits = n - 2;
+  if (digits < 1 || digits > 8 || n == len || (p[n] != ' ' && p[n] != '\t')) {
+    return 0;
+  }
+  while (n < len && (p[n] == ' ' || p[n] == '\t')) {
+    n++;
+  }
+  if (n + 1 != len || (p[n] != '0' && p[n] != '1')) {
+    return 0;
+  }
+  *outcome = p[n] - '0';
+  return hex_scalar(p + 2, digits, pc);
+}
+
+static void
+report(struct parse_state *st, const char *p, size_t len)
+{
+  int show = len > 32 ? 32 : (int)len;
+  snprintf(st->error, sizeof(st->error), "line %llu: malformed branch record \"%.*s\"",
+           (unsigned long long)st->line, show, p);
+}
+
+// Parser loop shared by every kernel set. The common "0x<hex> <d>" shape
+// is recognized from the line length alone.
+//
+#define DEFINE_PARSE_LOOP(NAME, ATTR, NEWLINE_MASK, HEX)                     \
+ATTR static long                                                              \
+NAME(struct parse_state *st, const char *buf, size_t len,                    \
+     uint32_t *pcs, uint8_t *outcomes, size_t max, size_t *consumed)          \
+{                                                                             \
+  size_t start = 0;                                                           \
+  size_t n = 0;                                                               \
+  for (size_t block = 0; block < len && n < max; block += 64) {              \
+    uint64_t m = NEWLINE_MASK(buf + block);                                   \
+    if (len - block < 64) {                                                   \
+      m &= (1ULL << (len - block)) - 1;                                       \
+    }                                                                         \
+    while (m && n < max) {                                                    \
+      size_t end = block + __builtin_ctzll(m);                                \
+      m &= m - 1;                                                             \
+      st->line++;                                                             \
+      const char *p = buf + start;                                            \
+      size_t l = end - start;                                                 \
+      int ok;                                                                 \
+      if (l >= 5 && l <= 12 && p[0] == '0' && (p[1] | 0x20) == 'x' &&         \
+          p[l - 2] == ' ' && (p[l - 1] == '0' || p[l - 1] == '1')) {          \
+        outcomes[n] = p[l - 1] - '0';                                         \
+        ok = HEX(p + 2, (int)l - 4, &pcs[n]) ||                               \
+             parse_line_slow(p, l, &pcs[n], &outcomes[n]);                    \
+      } else {                                                                \
+        ok = parse_line_slow(p, l, &pcs[n], &outcomes[n]);                    \
+      }                                                                       \
+      if (!ok) {                                                              \
+        report(st, p, l);                                                     \
+        *consumed = start;                                                    \
+        return -1;                                                            \
+      }                                                                       \
+      n++;                                                                    \
+      start = end + 1;                                                        \
+    }                                                                         \
+  }                                                                           \
+  *consumed = start;                                                          \
+  return n;                                                                   \
+}
+
+DEFINE_PARSE_LOOP(parse_scalar, , newline_mask_scalar, hex_scalar)
+#if HAVE_X86_SIMD
+DEFINE_PARSE_LOOP(parse_ssse3, TARGET_SSSE3, newline_mask_sse2, hex_ssse3)
+DEFINE_PARSE_LOOP(parse_avx2, TARGET_AVX2, newline_mask_avx2, hex_ssse3)
+#endif
+
+//------------------------------------//
+//              Dispatch              //
+//------------------------------------//
+
+typedef long (*parse_fn)(struct parse_state *, const char *, size_t,
+                         uint32_t *, uint8_t *, size_t, size_t *);
+
+static parse_fn parse_kernel;
+static pthread_once_t parse_once = PTHREAD_ONCE_INIT;
+
+static void
+parse_init(void)
+{
+  memset(hexval, 0x80, sizeof(hexval));
+  for (int c = 0; c < 10; c++) {
+    hexval['0' + c] = c;
+  }
+  for (int c = 0; c < 6; c++) {
+    hexval['a' + c] = 10 + c;
+    hexval['A' + c] = 10 + c;
+  }
+
+  parse_kernel = parse_scalar;
+#if HAVE_X86_SIMD
+  if (cpu_has_avx2()) {
+    parse_kernel = parse_avx2;
+  } else if (cpu_has_ssse3()) {
+    parse_kernel = parse_ssse3;
+  }
+#endif
+}
+
+long
+parse_branches(struct parse_state *st, const char *buf, size_t len,
+               uint32_t *pcs, uint8_t *outcomes, size_t max,
+               size_t *consumed)
+{
+  pthread_once(&parse_once, parse_init);
+  return parse_kernel(st, buf, len, pcs, outcomes, max, consumed);
+}
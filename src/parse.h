@@ -0,0 +1,33 @@
+//========================================================//
+//  parse.h                                               //
+//  Header file for the bulk text trace parser            //
+//========================================================//
+
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Bytes past the end of a parse buffer that must be readable. The
+// vector kernels load whole registers without checking the length.
+#define PARSE_PADDING 64
+
+struct parse_state
+{
+  uint64_t line;       // Number of lines parsed so far
+  char error[96];      // Set when a malformed line is found
+};
+
+// Parse the complete "0x<hex> <0|1>\n" lines at the start of 'buf' into
+// 'pcs' and 'outcomes', stopping after 'max' records. A trailing partial
+// line is left alone. *consumed is set to the number of bytes used.
+//
+// Returns the number of records, or -1 with st->error describing the
+// first malformed line
+//
+long parse_branches(struct parse_state *st, const char *buf, size_t len,
+                    uint32_t *pcs, uint8_t *outcomes, size_t max,
+                    size_t *consumed);
+
+#endif
@@ -0,0 +1,139 @@
+//========================================================//
+//  perceptron.c                                          //
+//  Source file for the perceptron kernels                //
+//                                                        //
+//  All kernels use exact integer arithmetic, so the      //
+//  vector and scalar versions agree bit for bit          //
+//========================================================//
+
+#include <pthread.h>
+#include "perceptron.h"
+#include "simd.h"
+
+static int
+dot_scalar(const int8_t *w, const int8_t *x, int n)
+{
+  int y = 0;
+  for (int j = 0; j < n; j++) {
+    y += w[j] * x[j];
+  }
+  return y;
+}
+
+static void
+train_scalar(int8_t *w, const int8_t *x, const int8_t *live, int n, int t)
+{
+  for (int j = 0; j < n; j++) {
+    int v = w[j] + (t * x[j] & live[j]);
+    if (v > PERCEPTRON_WEIGHT_MAX) {
+      v = PERCEPTRON_WEIGHT_MAX;
+    } else if (v < -PERCEPTRON_WEIGHT_MAX) {
+      v = -PERCEPTRON_WEIGHT_MAX;
+    }
+    w[j] = v;
+  }
+}
+
+#if HAVE_X86_SIMD
+
+// Since x is +1 or -1, w * x is a sign flip, and the int8 products are
+// widened pairwise to int16 and then int32 before they are summed.
+//
+TARGET_SSSE3 static int
+dot_ssse3(const int8_t *w, const int8_t *x, int n)
+{
+  const __m128i ones8 = _mm_set1_epi8(1);
+  const __m128i ones16 = _mm_set1_epi16(1);
+  __m128i sum = _mm_setzero_si128();
+
+  for (int j = 0; j < n; j += 16) {
+    __m128i p = _mm_sign_epi8(_mm_loadu_si128((const __m128i *)(w + j)),
+                              _mm_loadu_si128((const __m128i *)(x + j)));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(ones8, p), ones16));
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  return _mm_cvtsi128_si32(sum);
+}
+
+TARGET_SSSE3 static void
+train_ssse3(int8_t *w, const int8_t *x, const int8_t *live, int n, int t)
+{
+  const __m128i sign = _mm_set1_epi8(t);
+  const __m128i min = _mm_set1_epi8(-PERCEPTRON_WEIGHT_MAX - 1);
+
+  for (int j = 0; j < n; j += 16) {
+    __m128i d = _mm_sign_epi8(_mm_loadu_si128((const __m128i *)(x + j)), sign);
+    d = _mm_and_si128(d, _mm_loadu_si128((const __m128i *)(live + j)));
+    __m128i v = _mm_adds_epi8(_mm_loadu_si128((const __m128i *)(w + j)), d);
+    // adds saturates at -128, raise it to -127 (pmaxsb needs SSE4.1)
+    v = _mm_sub_epi8(v, _mm_cmpeq_epi8(v, min));
+    _mm_storeu_si128((__m128i *)(w + j), v);
+  }
+}
+
+TARGET_AVX2 static int
+dot_avx2(const int8_t *w, const int8_t *x, int n)
+{
+  const __m256i ones8 = _mm256_set1_epi8(1);
+  const __m256i ones16 = _mm256_set1_epi16(1);
+  __m256i sum = _mm256_setzero_si256();
+
+  for (int j = 0; j < n; j += 32) {
+    __m256i p = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *)(w + j)),
+                                 _mm256_loadu_si256((const __m256i *)(x + j)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(ones8, p), ones16));
+  }
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+  return _mm_cvtsi128_si32(s);
+}
+
+TARGET_AVX2 static void
+train_avx2(int8_t *w, const int8_t *x, const int8_t *live, int n, int t)
+{
+  const __m256i sign = _mm256_set1_epi8(t);
+  const __m256i low = _mm256_set1_epi8(-PERCEPTRON_WEIGHT_MAX);
+
+  for (int j = 0; j < n; j += 32) {
+    __m256i d = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *)(x + j)), sign);
+    d = _mm256_and_si256(d, _mm256_loadu_si256((const __m256i *)(live + j)));
+    __m256i v = _mm256_adds_epi8(_mm256_loadu_si256((const __m256i *)(w + j)), d);
+    _mm256_storeu_si256((__m256i *)(w + j), _mm256_max_epi8(v, low));
+  }
+}
+
+#endif
+
+static int (*dot_kernel)(const int8_t *w, const int8_t *x, int n) = dot_scalar;
+static void (*train_kernel)(int8_t *w, const int8_t *x, const int8_t *live, int n, int t) = train_scalar;
+static pthread_once_t perceptron_once = PTHREAD_ONCE_INIT;
+
+static void
+perceptron_dispatch(void)
+{
+#if HAVE_X86_SIMD
+  if (cpu_has_avx2()) {
+    dot_kernel = dot_avx2;
+    train_kernel = train_avx2;
+  } else if (cpu_has_ssse3()) {
+    dot_kernel = dot_ssse3;
+    train_kernel = train_ssse3;
+  }
+#endif
+}
+
+int
+perceptron_dot(const int8_t *w, const int8_t *x, int n)
+{
+  pthread_once(&perceptron_once, perceptron_dispatch);
+  return dot_kernel(w, x, n);
+}
+
+void
+perceptron_train(int8_t *w, const int8_t *x, const int8_t *live, int n, int t)
+{
+  pthread_once(&perceptron_once, perceptron_dispatch);
+  train_kernel(w, x, live, n, t);
+}
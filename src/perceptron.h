@@ -0,0 +1,35 @@
+//========================================================//
+//  perceptron.h                                          //
+//  Header file for the perceptron kernels                //
+//                                                        //
+//  Dot product and training of int8 weight rows against  //
+//  a +1/-1 history, vectorized where the CPU allows      //
+//========================================================//
+
+#ifndef PERCEPTRON_H
+#define PERCEPTRON_H
+
+#include <stdint.h>
+
+// Longest history a perceptron can weigh, a power of two
+#define PERCEPTRON_MAX_HISTORY 128
+
+// Rows of weights are padded to a multiple of this many lanes
+#define PERCEPTRON_LANES 32
+
+// Weights saturate at +/-PERCEPTRON_WEIGHT_MAX, so negating one never
+// overflows an int8_t
+#define PERCEPTRON_WEIGHT_MAX 127
+
+// Returns the sum of w[j] * x[j] for j < n. 'n' is a multiple of
+// PERCEPTRON_LANES.
+//
+int perceptron_dot(const int8_t *w, const int8_t *x, int n);
+
+// Add t * x[j] to each w[j] with live[j] set (-1), saturating at
+// +/-PERCEPTRON_WEIGHT_MAX. Lanes with live[j] 0 are left alone. 't' is
+// +1 or -1 and 'n' a multiple of PERCEPTRON_LANES.
+//
+void perceptron_train(int8_t *w, const int8_t *x, const int8_t *live, int n, int t);
+
+#endif
@@ -0,0 +1,147 @@
+//========================================================//
+//  perfstat.c                                            //
+//  Source file for the phase timing instrumentation      //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfstat.h"
+
+static const uint64_t perf_configs[PERF_EVENTS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static uint64_t start_ticks;
+static double start_seconds;
+
+// Ticks taken by reading the TSC twice, subtracted once per call
+static uint64_t overhead_ticks;
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void
+perf_start(void)
+{
+  start_seconds = now();
+  start_ticks = perf_ticks();
+
+  overhead_ticks = UINT64_MAX;
+  for (int i = 0; i < 1000; i++) {
+    uint64_t t = perf_ticks();
+    t = perf_ticks() - t;
+    if (t < overhead_ticks) {
+      overhead_ticks = t;
+    }
+  }
+}
+
+void
+perf_open(struct perf_counters *c)
+{
+  int leader = -1;
+  c->num = 0;
+  for (int k = 0; k < PERF_EVENTS; k++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = perf_configs[k];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    c->fd[k] = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    if (c->fd[k] < 0) {
+      continue;
+    }
+    if (leader < 0) {
+      leader = c->fd[k];
+    }
+    c->slot[k] = c->num++;
+  }
+}
+
+void
+perf_close(struct perf_counters *c)
+{
+  for (int k = 0; k < PERF_EVENTS; k++) {
+    if (c->fd[k] >= 0) {
+      close(c->fd[k]);
+    }
+  }
+  c->num = 0;
+}
+
+void
+perf_read(const struct perf_counters *c, uint64_t *events)
+{
+  // A group read returns the number of events and then their values
+  uint64_t buf[1 + PERF_EVENTS];
+  int leader = -1;
+  for (int k = 0; k < PERF_EVENTS && leader < 0; k++) {
+    leader = c->fd[k];
+  }
+  if (read(leader, buf, sizeof(buf)) < (ssize_t)((1 + c->num) * sizeof(uint64_t))) {
+    memset(buf, 0, sizeof(buf));
+  }
+  for (int k = 0; k < PERF_EVENTS; k++) {
+    events[k] = c->fd[k] >= 0 ? buf[1 + c->slot[k]] : 0;
+  }
+}
+
+void
+perf_end(const struct perf_counters *c, struct perf_phase *phase,
+         const struct perf_sample *start)
+{
+  phase->ticks += perf_ticks() - start->ticks;
+  phase->calls++;
+  if (c->num) {
+    uint64_t events[PERF_EVENTS];
+    perf_read(c, events);
+    for (int k = 0; k < PERF_EVENTS; k++) {
+      phase->events[k] += events[k] - start->events[k];
+    }
+    phase->have_events = 1;
+  }
+}
+
+void
+perf_report(FILE *f, const struct perf_phase *phases, int num, uint64_t branches)
+{
+  double seconds = now() - start_seconds;
+  uint64_t ticks = perf_ticks() - start_ticks;
+  double ns_per_tick = ticks ? seconds * 1e9 / ticks : 0;
+
+  fprintf(f, "%-24s %10s %10s %9s %6s %10s %10s\n", "Phase", "Calls", "ms", "ns/branch",
+          "IPC", "LLCmiss/kb", "BRmiss/kb");
+  for (int i = 0; i < num; i++) {
+    const struct perf_phase *ph = &phases[i];
+    uint64_t overhead = ph->calls * overhead_ticks;
+    double ns = (ph->ticks > overhead ? ph->ticks - overhead : 0) * ns_per_tick;
+    fprintf(f, "%-24s %10llu %10.1f %9.2f", ph->name, (unsigned long long)ph->calls,
+            ns * 1e-6, branches ? ns / branches : 0);
+    if (ph->have_events && ph->events[PERF_CYCLES]) {
+      double kb = branches ? branches / 1000.0 : 1;
+      fprintf(f, " %6.2f %10.2f %10.2f\n",
+              (double)ph->events[PERF_INSTRUCTIONS] / ph->events[PERF_CYCLES],
+              ph->events[PERF_CACHE_MISSES] / kb, ph->events[PERF_BRANCH_MISSES] / kb);
+    } else {
+      fprintf(f, " %6s %10s %10s\n", "-", "-", "-");
+    }
+  }
+  fprintf(f, "%-24s %10s %10.1f %9.2f  (%.2f GHz TSC)\n", "wall", "", seconds * 1e3,
+          branches ? seconds * 1e9 / branches : 0, ns_per_tick ? 1 / ns_per_tick : 0);
+}
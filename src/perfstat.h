@@ -0,0 +1,112 @@
+//========================================================//
+//  perfstat.h                                            //
+//  Header file for the phase timing instrumentation      //
+//                                                        //
+//  Phases are timed with the TSC and, where the kernel   //
+//  allows it, with a perf_event group of hardware        //
+//  counters of the calling thread                        //
+//========================================================//
+
+#ifndef PERFSTAT_H
+#define PERFSTAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// The hardware events counted per phase
+#define PERF_CYCLES        0
+#define PERF_INSTRUCTIONS  1
+#define PERF_CACHE_MISSES  2
+#define PERF_BRANCH_MISSES 3
+#define PERF_EVENTS        4
+
+// The counters of one thread. Events the kernel refused have an fd of
+// -1, so with no PMU (or perf_event_paranoid too high) only the TSC is
+// sampled.
+struct perf_counters
+{
+  int fd[PERF_EVENTS];
+  int slot[PERF_EVENTS];  // Position of each event in a group read
+  int num;                // Number of events opened
+};
+
+struct perf_sample
+{
+  uint64_t ticks;
+  uint64_t events[PERF_EVENTS];
+};
+
+// Totals of one phase
+struct perf_phase
+{
+  const char *name;
+  uint64_t calls;
+  uint64_t ticks;
+  uint64_t events[PERF_EVENTS];
+  int have_events;        // Set once a sample with counters was added
+};
+
+// Note the start of the run, ticks are converted to ns over the time
+// between perf_start and perf_report
+//
+void perf_start(void);
+
+// Open the counters for the calling thread
+//
+void perf_open(struct perf_counters *c);
+
+void perf_close(struct perf_counters *c);
+
+static inline uint64_t
+perf_ticks(void)
+{
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Read the counters of 'c' before taking the TSC, so the read itself
+// is not timed
+//
+void perf_read(const struct perf_counters *c, uint64_t *events);
+
+static inline void
+perf_begin(const struct perf_counters *c, struct perf_sample *s)
+{
+  if (c->num) {
+    perf_read(c, s->events);
+  }
+  s->ticks = perf_ticks();
+}
+
+// Add the time and events since 'start' to 'phase'
+//
+void perf_end(const struct perf_counters *c, struct perf_phase *phase,
+              const struct perf_sample *start);
+
+// Add the ticks since 'start' to 'phase', for per-branch phases that
+// are too short to read the counters around
+//
+static inline void
+perf_end_ticks(struct perf_phase *phase, uint64_t start)
+{
+  phase->ticks += perf_ticks() - start;
+  phase->calls++;
+}
+
+// Print ns per branch, IPC, and cache and branch misses per thousand
+// branches of each phase to 'f'
+//
+void perf_report(FILE *f, const struct perf_phase *phases, int num, uint64_t branches);
+
+#endif
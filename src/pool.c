@@ -0,0 +1,149 @@
+//========================================================//
+//  pool.c                                                //
+//  Source file for the work-stealing job pool            //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <unistd.h>
+#include "pool.h"
+
+// The jobs a worker still owns, [lo, hi). The owner takes from the
+// bottom, thieves take the top half, so both sides rarely touch the
+// same jobs and the owner keeps working through neighbouring jobs.
+struct deque
+{
+  pthread_mutex_t lock;
+  size_t lo;
+  size_t hi;
+};
+
+struct pool
+{
+  int workers;
+  struct deque *deques;
+  pool_job job;
+  void *arg;
+};
+
+struct worker
+{
+  struct pool *pool;
+  int id;
+};
+
+int
+pool_default_workers(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+// Take the next job of worker 'id'
+//
+// Returns 1 and sets *index if the worker still owned a job
+//
+static int
+pop(struct pool *p, int id, size_t *index)
+{
+  struct deque *d = &p->deques[id];
+  int found = 0;
+
+  pthread_mutex_lock(&d->lock);
+  if (d->lo < d->hi) {
+    *index = d->lo++;
+    found = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return found;
+}
+
+// Move the top half of some other worker's jobs to worker 'id'. No jobs
+// are ever added, so once a full sweep finds every deque empty all the
+// remaining work is already claimed.
+//
+// Returns 1 if anything was stolen
+//
+static int
+steal(struct pool *p, int id)
+{
+  for (int i = 1; i < p->workers; i++) {
+    struct deque *victim = &p->deques[(id + i) % p->workers];
+    size_t lo = 0, hi = 0;
+
+    pthread_mutex_lock(&victim->lock);
+    if (victim->lo < victim->hi) {
+      size_t mid = victim->lo + (victim->hi - victim->lo) / 2;
+      lo = mid;
+      hi = victim->hi;
+      victim->hi = mid;
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    if (lo < hi) {
+      struct deque *d = &p->deques[id];
+      pthread_mutex_lock(&d->lock);
+      d->lo = lo;
+      d->hi = hi;
+      pthread_mutex_unlock(&d->lock);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void *
+worker_main(void *arg)
+{
+  struct worker *w = arg;
+  struct pool *p = w->pool;
+  size_t index;
+
+  do {
+    while (pop(p, w->id, &index)) {
+      p->job(p->arg, index, w->id);
+    }
+  } while (steal(p, w->id));
+
+  return NULL;
+}
+
+void
+pool_run(int workers, size_t jobs, pool_job job, void *arg)
+{
+  if (workers <= 0) {
+    workers = pool_default_workers();
+  }
+  if ((size_t)workers > jobs) {
+    workers = jobs > 0 ? (int)jobs : 1;
+  }
+
+  struct pool p = { workers, calloc(workers, sizeof(struct deque)), job, arg };
+  struct worker *w = calloc(workers, sizeof(struct worker));
+  pthread_t *threads = calloc(workers, sizeof(pthread_t));
+
+  // Deal the jobs out in equal contiguous ranges
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_init(&p.deques[i].lock, NULL);
+    p.deques[i].lo = jobs * i / workers;
+    p.deques[i].hi = jobs * (i + 1) / workers;
+    w[i].pool = &p;
+    w[i].id = i;
+  }
+
+  // The calling thread works as worker 0
+  for (int i = 1; i < workers; i++) {
+    pthread_create(&threads[i], NULL, worker_main, &w[i]);
+  }
+  worker_main(&w[0]);
+  for (int i = 1; i < workers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_destroy(&p.deques[i].lock);
+  }
+  free(threads);
+  free(w);
+  free(p.deques);
+}
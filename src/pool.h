@@ -0,0 +1,29 @@
+//========================================================//
+//  pool.h                                                //
+//  Header file for the work-stealing job pool            //
+//                                                        //
+//  Jobs are numbered 0..n-1 and dealt out to the workers //
+//  as contiguous ranges; a worker that runs dry steals   //
+//  the upper half of another worker's remaining range    //
+//========================================================//
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdlib.h>
+
+typedef void (*pool_job)(void *arg, size_t index, int worker);
+
+// Number of workers used when 0 is passed to pool_run, the number of
+// online CPUs
+//
+int pool_default_workers(void);
+
+// Call job(arg, i, worker) once for every i in [0, jobs) on 'workers'
+// threads and wait for all of them to finish. 'worker' is the index of
+// the calling thread in [0, workers) and can be used for per-thread
+// scratch state.
+//
+void pool_run(int workers, size_t jobs, pool_job job, void *arg);
+
+#endif
@@ -6,9 +6,14 @@
 //  described in the README                               //
 //========================================================//
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <math.h>
 #include "predictor.h"
+#include "history.h"
+#include "perceptron.h"
+#include "profile.h"
 
 //
 // TODO:Student Information
@@ -21,9 +26,8 @@ const char *email = "jid001@ucsd.edu";
 //      Predictor Configuration       //
 //------------------------------------//
 
-// Handy Global for use in output routines
-const char *bpName[4] = {"Static", "Gshare",
-                         "Tournament", "Custom"};
+// The globals below are the defaults filled in by predictor_config_init
+// and used by the init_predictor/make_prediction/train_predictor wrappers
 
 // define number of bits required for indexing the BHT here.
 int ghistoryBits = 14; // Number of bits used for Global History
@@ -35,6 +39,28 @@ int alpha21264LhistoryBits = 11; // Number of bits of saturating counter used fo
 int alpha21264LIndexBits = 10;   // Number of Program counter bits used for Local history table
 int alpha21264ChoiceBits = 12;   // Number of Path history bits used for Choice prediction
 
+int T0_PC = 10;
+int Ti_PC = 8;
+int tag_bit = 11;
+int tage_component_used_length[TAGE_COMPONENTS] = {5, 9, 15, 25, 44, 76, 130};
+int tage_altpred = 1;  // Full update with the alternate prediction
+int tage_loopBits = 5; // 2^5 loop predictor entries
+int tage_scBits = 5;   // 2^5 entries per statistical corrector table
+
+int bimode_nt_ghistoryBits = 11;
+int bimode_t_ghistoryBits = 11;
+int ct_PCBits = 11;
+
+int custLhistoryBits = 10; // Number of bits of saturating counter used for Local prediction
+int custLIndexBits = 10;   // Number of Program counter bits used for Local history table
+int custChoiceBits = 12;   // Number of Path history bits used for Choice prediction
+
+int perceptronHistoryBits = 31; // Global history length of the perceptrons
+int perceptronIndexBits = 7;    // 2^7 perceptrons of 32 8-bit weights each
+int perceptronHashed = 0;       // Index the perceptrons by PC alone
+
+int packedTables = 0; // Store 2-bit counters four per byte and local histories at their width
+
 //------------------------------------//
 //      Predictor Data Structures     //
 //------------------------------------//
@@ -42,122 +68,366 @@ int alpha21264ChoiceBits = 12;   // Number of Path history bits used for Choice
 //
 // TODO: Add your own Branch Predictor data structures here
 //
+
+// A table of 2-bit counters, one per byte or, when packed, four per
+// byte so the table takes the space the hardware budget accounts for
+struct counter_table
+{
+  uint8_t *c;
+  int packed;
+};
+
+// A table of local histories, one uint64_t each or, when packed,
+// 'width' bits each
+struct history_table
+{
+  uint64_t *h;
+  uint8_t *bits;
+  int width;
+};
 // gshare
-uint8_t *bht_gshare;
-uint64_t ghistory;
+struct gshare
+{
+  struct gshare_config cfg;
+  struct counter_table bht;
+  uint64_t ghistory;
+};
 
 // Alpha21264
-uint64_t *lht_alpha21264;
-uint8_t *lpt_alpha21264;
+struct alpha21264
+{
+  struct alpha21264_config cfg;
+  uint64_t ghistory;
+  struct history_table lht;
+  struct counter_table lpt;
 
-uint8_t *gpt_alpha21264;
+  struct counter_table gpt;
 
-uint8_t *ct_alpha21264;
+  struct counter_table ct;
+};
 
 // Custom: TAGE
-#define TAGE_GHR_SIZE_QW 4
-#define COMPONENT_NUM 7
+// A tagged entry packs its prediction counter, useful counter and tag
+// into one 16-bit word:
+//
+//   tag << TAGE_TAG_SHIFT | u << TAGE_CTR_BITS | ctr
+//
+#define TAGE_CTR_BITS     3
+#define TAGE_U_BITS       2
+#define TAGE_TAG_SHIFT    (TAGE_CTR_BITS + TAGE_U_BITS)
+#define TAGE_CTR_MAX      ((1 << TAGE_CTR_BITS) - 1)
+#define TAGE_U_MAX        ((1 << TAGE_U_BITS) - 1)
+#define TAGE_CTR_INIT     4 // Weakly taken
+#define TAGE_T0_INIT      WT
+
+typedef uint16_t tage_entry;
+
+// Each component hashes three folds of its history length: one to the
+// index width and two to the tag width
+#define TAGE_FOLD_INDEX(i) (i)
+#define TAGE_FOLD_TAG1(i)  (TAGE_COMPONENTS + (i))
+#define TAGE_FOLD_TAG2(i)  (2 * TAGE_COMPONENTS + (i))
+
+// With altpred, the alternate prediction replaces a newly allocated
+// provider's while the 4-bit use_alt_on_na counter is at least 8
+#define TAGE_USE_ALT_MAX  15
+#define TAGE_USE_ALT_INIT 8
+
+// How lookup_tage got to its prediction, kept in the token's aux
+#define TAGE_AUX_TAGE       0x01 // TAGE's prediction
+#define TAGE_AUX_ALT        0x02 // The alternate prediction
+#define TAGE_AUX_INTER      0x04 // After the loop predictor, the SC input
+#define TAGE_AUX_LOOP_HIT   0x08 // The loop predictor has an entry
+#define TAGE_AUX_LOOP_VALID 0x10 // ...with full confidence
+#define TAGE_AUX_LOOP_PRED  0x20 // ...predicting taken
+
+// A loop predictor entry learns branches that go one way 'past' times
+// in a row and then the other way once
+#define TAGE_LOOP_TAG_BITS  10
+#define TAGE_LOOP_ITER_BITS 10
+#define TAGE_LOOP_ITER_MASK ((1 << TAGE_LOOP_ITER_BITS) - 1)
+#define TAGE_LOOP_CONF_MAX  3
+#define TAGE_LOOP_AGE_MAX   7
+#define TAGE_LOOP_ENTRY_BITS (TAGE_LOOP_TAG_BITS + 2 * TAGE_LOOP_ITER_BITS + 2 + 3 + 1)
+#define TAGE_WITH_LOOP_MIN  -64 // 7-bit counter, the loop predictor is
+#define TAGE_WITH_LOOP_MAX  63  // used from 0 up
+
+struct tage_loop
+{
+  uint16_t tag;
+  uint16_t past;     // Length of the last run
+  uint16_t cur;      // Length of the current run
+  uint8_t conf;      // Times in a row 'past' repeated
+  uint8_t age;       // Replaced when it reaches 0
+  uint8_t dir;       // Direction inside the loop
+};
 
-int T0_PC = 10;
-int Ti_PC = 8;
-int tag_bit = 11;
-int u_bit = 2;
-int pred_bit = 3;
+// The statistical corrector sums 6-bit counters from a bias table and
+// GEHL tables over short global histories, plus a vote for the
+// prediction it corrects. Its output is the sign of the sum.
+#define TAGE_SC_CTR_MIN   -32
+#define TAGE_SC_CTR_MAX   31
+#define TAGE_SC_CTR_BITS  6
+#define TAGE_SC_THETA     24  // Initial training threshold
+#define TAGE_SC_TC_MAX    32  // 7-bit threshold counter
+#define TAGE_FOLD_SC(j)   (3 * TAGE_COMPONENTS + (j) - 1)
+
+// History length of each SC table, table 0 is the bias table
+static const int tage_sc_length[TAGE_SC_TABLES] = {0, 4, 10, 22};
+
+struct tage
+{
+  struct tage_config cfg;
+  uint8_t *T0;                           // 2-bit base predictor
+  tage_entry *entries;                   // All components in one block
+  tage_entry *component[TAGE_COMPONENTS]; // Start of each component in entries
+  struct folded_history hist;           // Global history and its folds
+  uint64_t rng; // Private random state for allocation, keeps instances reentrant
+  uint8_t use_alt;                       // use_alt_on_na
+  struct tage_loop *loop;                // Loop predictor
+  int with_loop;                         // Trust in the loop predictor
+  int8_t *sc[TAGE_SC_TABLES];            // Statistical corrector tables
+  int sc_theta;                          // SC training threshold
+  int sc_tc;                             // Moves sc_theta when it saturates
+};
+
+// Bimode
+struct bimode
+{
+  struct bimode_config cfg;
+  uint64_t ghistory; // Also drives the choice table of cust
+  struct counter_table pht_nt;
+  struct counter_table pht_t;
+  struct counter_table ct;
+};
+
+// Cust
+struct cust
+{
+  struct cust_config cfg;
+  struct history_table lht;
+  struct counter_table lpt;
+
+  struct counter_table ct;
+
+  struct bimode bimode;
+};
+
+// Perceptron, one row of 8-bit weights per perceptron weighs the
+// global history as +1 (taken) / -1 (not taken)
+struct perceptron
+{
+  struct perceptron_config cfg;
+  int theta;             // Train while |output| is at most this
+  int8_t *bias;          // Bias weight of each row
+  int8_t *weights;       // Rows of historyBits weights, padded to PERCEPTRON_LANES
+  int8_t live[PERCEPTRON_MAX_HISTORY]; // -1 for the lanes of a row that hold weights
+
+  // The outcome 'age' branches ago is history[pos + age], stored twice
+  // like folded_history so a whole row of it is contiguous
+  uint32_t pos;
+  int8_t history[2 * PERCEPTRON_MAX_HISTORY];
+  uint32_t ghistory;     // The same history as bits, for the hashed index
+};
+
+// A predictor instance, only the member selected by 'type' is used
+struct predictor
+{
+  int type;
+  const struct predictor_type *ops; // Entry points of the type
+  batch_kernel kernel;              // Specialized or generic batch loop
+  struct gshare gshare;
+  struct alpha21264 alpha21264;
+  struct tage tage;
+  struct bimode bimode;
+  struct cust cust;
+  struct perceptron perceptron;
+};
+
+//------------------------------------//
+//          Counter Updates           //
+//------------------------------------//
+//
+// The counters are trained with arithmetic instead of a switch on their
+// state, so the hot path has no branches that depend on the data.
+//
+
+// Returns the direction predicted by a 2-bit counter
+static inline uint8_t counter_prediction(uint8_t ctr)
+{
+  return ctr >> 1;
+}
+
+// Returns an n-bit saturating counter moved one step up if 'up' is set
+// and down otherwise, 'max' is 2^n - 1
+static inline uint8_t counter_step(uint8_t ctr, uint8_t up, uint8_t max)
+{
+  return ctr + (up & (ctr != max)) - (!up & (ctr != 0));
+}
+
+// Same as counter_step when 'enable' is set, otherwise 'ctr' unchanged
+static inline uint8_t counter_step_if(uint8_t ctr, uint8_t enable, uint8_t up, uint8_t max)
+{
+  uint8_t next = counter_step(ctr, up, max);
+  return ctr ^ ((ctr ^ next) & -enable);
+}
 
-uint64_t tage_ghr[TAGE_GHR_SIZE_QW];
+// Returns a 2-bit choice counter trained when 'enable' is set. In SN/WN
+// it chooses the first predictor and steps up (towards the second) when
+// the first was wrong; in WT/ST it steps up when the second was right.
+static inline uint8_t choice_step(uint8_t ct, uint8_t enable, uint8_t outcome,
+                                  uint8_t first, uint8_t second)
+{
+  uint8_t chosen = counter_prediction(ct);
+  uint8_t up = (chosen & (outcome == second)) | (!chosen & (outcome != first));
+  return counter_step_if(ct, enable, up, ST);
+}
+
+static inline uint8_t tage_ctr(tage_entry e)
+{
+  return e & TAGE_CTR_MAX;
+}
+
+static inline uint8_t tage_u(tage_entry e)
+{
+  return (e >> TAGE_CTR_BITS) & TAGE_U_MAX;
+}
+
+static inline uint32_t tage_tag(tage_entry e)
+{
+  return e >> TAGE_TAG_SHIFT;
+}
+
+static inline tage_entry tage_make_entry(uint32_t tag, uint8_t u, uint8_t ctr)
+{
+  return (tage_entry)(tag << TAGE_TAG_SHIFT | u << TAGE_CTR_BITS | ctr);
+}
+
+// Move the prediction counter of 'e' up if 'up' is set, down otherwise
+static inline void tage_step_ctr(tage_entry *e, uint8_t up)
+{
+  *e = (*e & ~TAGE_CTR_MAX) | counter_step(tage_ctr(*e), up, TAGE_CTR_MAX);
+}
+
+// Move the useful counter of 'e' up if 'up' is set, down otherwise
+static inline void tage_step_u(tage_entry *e, uint8_t up)
+{
+  *e = (*e & ~(TAGE_U_MAX << TAGE_CTR_BITS)) | counter_step(tage_u(*e), up, TAGE_U_MAX) << TAGE_CTR_BITS;
+}
 
-uint64_t get_bit_in_tage_ghr(uint64_t idx)
+void init_counter_table(struct counter_table *t, uint32_t entries, int packed)
 {
-  int q = idx / 64;
-  int r = idx % 64;
-  return (tage_ghr[q] << (63 - r)) >> 63;
+  t->packed = packed;
+  t->c = (uint8_t *)calloc(packed ? (entries + 3) / 4 : entries, sizeof(uint8_t));
 }
 
-void update_tage_ghr(uint64_t outcome)
+// Set the first 'entries' counters to 'value'
+void fill_counter_table(struct counter_table *t, uint32_t entries, uint8_t value)
 {
-  uint64_t msb[TAGE_GHR_SIZE_QW];
-  for (size_t i = 0; i < TAGE_GHR_SIZE_QW; i++)
+  if (t->packed)
   {
-    msb[i] = tage_ghr[i] >> 63;
-    tage_ghr[i] = tage_ghr[i] << 1;
+    memset(t->c, value * 0x55, entries / 4);
+    for (uint32_t i = entries & ~3u; i < entries; i++)
+    {
+      t->c[i >> 2] = (t->c[i >> 2] & ~(3 << (i & 3) * 2)) | value << (i & 3) * 2;
+    }
   }
-  tage_ghr[0] = tage_ghr[0] | outcome;
-  for (size_t i = 1; i < TAGE_GHR_SIZE_QW; i++)
+  else
   {
-    tage_ghr[i] = tage_ghr[i] | msb[i - 1];
+    memset(t->c, value, entries);
   }
 }
 
-struct circular_shift_register
+static inline uint8_t get_counter(const struct counter_table *t, uint32_t i, int packed)
 {
-  uint32_t r;
-  uint8_t bits;
-};
+  if (packed)
+  {
+    return (t->c[i >> 2] >> (i & 3) * 2) & 3;
+  }
+  return t->c[i];
+}
 
-void update_csr(struct circular_shift_register *p, uint64_t used_length)
+static inline void set_counter(struct counter_table *t, uint32_t i, uint8_t value, int packed)
 {
-  uint64_t mask = 1;
-  mask = (mask << p->bits) - 1;
-  uint64_t new_lsb = (p->r >> (p->bits - 1)) ^ (tage_ghr[0] & 1);
-  p->r = (p->r << 1) & mask | new_lsb;
-  p->r = p->r ^ (get_bit_in_tage_ghr(used_length) << (used_length % p->bits));
+  if (packed)
+  {
+    uint8_t shift = (i & 3) * 2;
+    t->c[i >> 2] = (t->c[i >> 2] & ~(3 << shift)) | value << shift;
+  }
+  else
+  {
+    t->c[i] = value;
+  }
 }
 
-struct saturating_counter
+void cleanup_counter_table(struct counter_table *t)
 {
-  uint8_t ctr;
-  uint8_t bits;
-};
+  free(t->c);
+}
 
-uint8_t get_saturating_counter(struct saturating_counter *p)
+// Packed entries are read and written through an unaligned 32-bit
+// window, which holds any width up to 24 bits wherever it starts
+#define HISTORY_TABLE_PAD 4
+
+void init_history_table(struct history_table *t, uint32_t entries, int width, int packed)
 {
-  if (p->ctr & (1 << (p->bits - 1)))
+  t->width = packed ? width : 0;
+  t->h = NULL;
+  t->bits = NULL;
+  if (packed)
   {
-    return TAKEN;
+    t->bits = (uint8_t *)calloc(((uint64_t)entries * width + 7) / 8 + HISTORY_TABLE_PAD, sizeof(uint8_t));
   }
   else
   {
-    return NOTTAKEN;
+    t->h = (uint64_t *)calloc(entries, sizeof(uint64_t));
   }
 }
 
-void inc_saturating_counter(struct saturating_counter *p)
+static inline uint64_t get_history(const struct history_table *t, uint32_t i)
 {
-  if (p->ctr == ((1 << p->bits) - 1))
-  {
-    return;
-  }
-  else
+  if (t->width)
   {
-    p->ctr += 1;
+    uint64_t bit = (uint64_t)i * t->width;
+    uint32_t w;
+    memcpy(&w, t->bits + (bit >> 3), sizeof(w));
+    return (w >> (bit & 7)) & ((1u << t->width) - 1);
   }
+  return t->h[i];
 }
 
-void dec_saturating_counter(struct saturating_counter *p)
+// Packed entries keep only the low 'width' bits, all the predictors use
+static inline void set_history(struct history_table *t, uint32_t i, uint64_t value)
 {
-  if (p->ctr == 0)
+  if (t->width)
   {
-    return;
+    uint64_t bit = (uint64_t)i * t->width;
+    uint32_t mask = ((1u << t->width) - 1) << (bit & 7);
+    uint32_t w;
+    memcpy(&w, t->bits + (bit >> 3), sizeof(w));
+    w = (w & ~mask) | (((uint32_t)value << (bit & 7)) & mask);
+    memcpy(t->bits + (bit >> 3), &w, sizeof(w));
   }
   else
   {
-    p->ctr -= 1;
+    t->h[i] = value;
   }
 }
 
-struct tage_component_entry
+void cleanup_history_table(struct history_table *t)
 {
-  struct saturating_counter pred;
-  struct saturating_counter u;
-  uint64_t tag;
-};
+  free(t->h);
+  free(t->bits);
+}
 
-struct saturating_counter *T0;
-struct tage_component_entry *tage_component[COMPONENT_NUM];
-uint64_t tage_component_used_length[COMPONENT_NUM] = {5, 9, 15, 25, 44, 76, 130};
-struct circular_shift_register csr0[COMPONENT_NUM];
-struct circular_shift_register csr1[COMPONENT_NUM];
-struct circular_shift_register csr2[COMPONENT_NUM];
+// xorshift64, replaces rand() so that instances do not share state
+uint64_t tage_rand(struct tage *p)
+{
+  p->rng ^= p->rng << 13;
+  p->rng ^= p->rng >> 7;
+  p->rng ^= p->rng << 17;
+  return p->rng >> 33;
+}
 
 //------------------------------------//
 //        Predictor Functions         //
@@ -167,783 +437,1381 @@ struct circular_shift_register csr2[COMPONENT_NUM];
 //
 
 // gshare functions
-void init_gshare()
+void init_gshare(struct gshare *p, const struct gshare_config *cfg)
 {
-  int bht_entries = 1 << ghistoryBits;                           // 2^14 entries in BHT
-  bht_gshare = (uint8_t *)malloc(bht_entries * sizeof(uint8_t)); // 2^14 * 2 (bit counter) = 2^15 = 32 Kb
-  int i = 0;
-  for (i = 0; i < bht_entries; i++)
-  {
-    bht_gshare[i] = WN;
-  }
-  ghistory = 0;
+  p->cfg = *cfg;
+  int bht_entries = 1 << p->cfg.ghistoryBits;                 // 2^14 entries in BHT
+  init_counter_table(&p->bht, bht_entries, p->cfg.packed);    // 2^14 * 2 (bit counter) = 2^15 = 32 Kb
+  fill_counter_table(&p->bht, bht_entries, WN);
+  p->ghistory = 0;
 }
 
-uint8_t gshare_predict(uint32_t pc)
+static uint8_t lookup_gshare(struct gshare *p, const struct gshare_config *cfg, uint32_t pc, struct predictor_token *l)
 {
   // get lower ghistoryBits of pc
-  uint32_t bht_entries = 1 << ghistoryBits;
+  uint32_t bht_entries = 1 << cfg->ghistoryBits;
   uint32_t pc_lower_bits = pc & (bht_entries - 1);
-  uint32_t ghistory_lower_bits = ghistory & (bht_entries - 1);
+  uint32_t ghistory_lower_bits = p->ghistory & (bht_entries - 1);
   uint32_t index = pc_lower_bits ^ ghistory_lower_bits;
-  switch (bht_gshare[index])
-  {
-  case WN:
-    return NOTTAKEN;
-  case SN:
-    return NOTTAKEN;
-  case WT:
-    return TAKEN;
-  case ST:
-    return TAKEN;
-  default:
-    printf("Warning: Undefined state of entry in GSHARE BHT!\n");
-    return NOTTAKEN;
-  }
+
+  l->index[0] = index;
+  l->provider = 0;
+  return l->prediction = counter_prediction(get_counter(&p->bht, index, cfg->packed));
 }
 
-void train_gshare(uint32_t pc, uint8_t outcome)
+static void update_gshare(struct gshare *p, const struct gshare_config *cfg, uint8_t outcome, const struct predictor_token *l)
 {
-  // get lower ghistoryBits of pc
-  uint32_t bht_entries = 1 << ghistoryBits;
-  uint32_t pc_lower_bits = pc & (bht_entries - 1);
-  uint32_t ghistory_lower_bits = ghistory & (bht_entries - 1);
-  uint32_t index = pc_lower_bits ^ ghistory_lower_bits;
+  uint32_t index = l->index[0];
 
   // Update state of entry in bht based on outcome
-  switch (bht_gshare[index])
-  {
-  case WN:
-    bht_gshare[index] = (outcome == TAKEN) ? WT : SN;
-    break;
-  case SN:
-    bht_gshare[index] = (outcome == TAKEN) ? WN : SN;
-    break;
-  case WT:
-    bht_gshare[index] = (outcome == TAKEN) ? ST : WN;
-    break;
-  case ST:
-    bht_gshare[index] = (outcome == TAKEN) ? ST : WT;
-    break;
-  default:
-    printf("Warning: Undefined state of entry in GSHARE BHT!\n");
-  }
+  set_counter(&p->bht, index, counter_step(get_counter(&p->bht, index, cfg->packed), outcome, ST), cfg->packed);
 
   // Update history register
-  ghistory = ((ghistory << 1) | outcome);
+  p->ghistory = ((p->ghistory << 1) | outcome);
 }
 
-void cleanup_gshare()
+void cleanup_gshare(struct gshare *p)
 {
-  free(bht_gshare);
+  cleanup_counter_table(&p->bht);
 }
 
 // alpha21264 functions
-void init_alpha21264()
+void init_alpha21264(struct alpha21264 *p, const struct alpha21264_config *cfg)
 {
-  int lht_entries = 1 << alpha21264LIndexBits;                         // 2^10 entries in LHT (Local histort table)
-  int lpt_entries = 1 << alpha21264LhistoryBits;                       // 2^11 entries in LPT (Local prediction table)
-  int gpt_entries = 1 << alpha21264GhistoryBits;                       // 2^12 entries in GPT (Global prediction table)
-  int choice_entries = 1 << alpha21264ChoiceBits;                      // 2^12 entries in CT (Choice prediction table)
-  lht_alpha21264 = (uint64_t *)calloc(lht_entries, sizeof(uint64_t));  // 2^10 * 11 (bit counter) = 11 * 2^10 bits
-  lpt_alpha21264 = (uint8_t *)malloc(lpt_entries * sizeof(uint8_t));   // 2^11 * 2 (bit counter) = 4 * 2^10 bits
-  gpt_alpha21264 = (uint8_t *)malloc(gpt_entries * sizeof(uint8_t));   // 2^12 * 2 (bit counter) = 8 * 2^10 bits
-  ct_alpha21264 = (uint8_t *)malloc(choice_entries * sizeof(uint8_t)); // 2^12 * 2 (bit counter) = 8 * 2^10 bits
-                                                                       // total: (11 + 4 + 8 + 8) * 2^10 bits = 31 * 2^10 bits = 31744 bits < 32Kbits = 32768 bits
-
-  memset(lpt_alpha21264, WN, lht_entries);
-  memset(gpt_alpha21264, WN, gpt_entries);
-  memset(ct_alpha21264, WN, choice_entries);
-
-  ghistory = 0;
+  p->cfg = *cfg;
+  int lht_entries = 1 << p->cfg.lIndexBits;                   // 2^10 entries in LHT (Local histort table)
+  int lpt_entries = 1 << p->cfg.lhistoryBits;                 // 2^11 entries in LPT (Local prediction table)
+  int gpt_entries = 1 << p->cfg.ghistoryBits;                 // 2^12 entries in GPT (Global prediction table)
+  int choice_entries = 1 << p->cfg.choiceBits;                // 2^12 entries in CT (Choice prediction table)
+  init_history_table(&p->lht, lht_entries, p->cfg.lhistoryBits, p->cfg.packed); // 2^10 * 11 (bit counter) = 11 * 2^10 bits
+  init_counter_table(&p->lpt, lpt_entries, p->cfg.packed);    // 2^11 * 2 (bit counter) = 4 * 2^10 bits
+  init_counter_table(&p->gpt, gpt_entries, p->cfg.packed);    // 2^12 * 2 (bit counter) = 8 * 2^10 bits
+  init_counter_table(&p->ct, choice_entries, p->cfg.packed);  // 2^12 * 2 (bit counter) = 8 * 2^10 bits
+                                                              // total: (11 + 4 + 8 + 8) * 2^10 bits = 31 * 2^10 bits = 31744 bits < 32Kbits = 32768 bits
+
+  // Only the first lht_entries counters start out weakly not taken, the
+  // rest are left strongly not taken; the published results depend on it
+  fill_counter_table(&p->lpt, lht_entries < lpt_entries ? lht_entries : lpt_entries, WN);
+  fill_counter_table(&p->gpt, gpt_entries, WN);
+  fill_counter_table(&p->ct, choice_entries, WN);
+
+  p->ghistory = 0;
 }
 
-uint8_t alpha21264_predict(uint32_t pc)
+static uint8_t lookup_alpha21264(struct alpha21264 *p, const struct alpha21264_config *cfg, uint32_t pc, struct predictor_token *l)
 {
   // get lower ghistoryBits of pc
-  uint32_t lht_entries = 1 << alpha21264LIndexBits;
+  uint32_t lht_entries = 1 << cfg->lIndexBits;
   uint32_t lht_index = pc & (lht_entries - 1);
 
-  uint32_t lpt_entries = 1 << alpha21264LhistoryBits;
-  uint32_t lpt_index = lht_alpha21264[lht_index] & (lpt_entries - 1);
+  uint32_t lpt_entries = 1 << cfg->lhistoryBits;
+  uint32_t lpt_index = get_history(&p->lht, lht_index) & (lpt_entries - 1);
 
-  uint32_t gpt_entries = 1 << alpha21264GhistoryBits;
-  uint32_t gpt_index = ghistory & (gpt_entries - 1);
+  uint32_t gpt_entries = 1 << cfg->ghistoryBits;
+  uint32_t gpt_index = p->ghistory & (gpt_entries - 1);
 
-  uint32_t ct_entries = 1 << alpha21264ChoiceBits;
-  uint32_t ct_index = ghistory & (ct_entries - 1);
+  uint32_t ct_entries = 1 << cfg->choiceBits;
+  uint32_t ct_index = p->ghistory & (ct_entries - 1);
 
-  if (ct_alpha21264[ct_index] >= SN && ct_alpha21264[ct_index] <= WN)
-  {
-    switch (lpt_alpha21264[lpt_index])
-    {
-    case WN:
-      return NOTTAKEN;
-    case SN:
-      return NOTTAKEN;
-    case WT:
-      return TAKEN;
-    case ST:
-      return TAKEN;
-    default:
-      printf("Warning: Undefined state of entry in Alpha21264 LPT!\n");
-      return NOTTAKEN;
-    }
-  }
-  else if (ct_alpha21264[ct_index] >= WT && ct_alpha21264[ct_index] <= ST)
-  {
-    switch (gpt_alpha21264[gpt_index])
-    {
-    case WN:
-      return NOTTAKEN;
-    case SN:
-      return NOTTAKEN;
-    case WT:
-      return TAKEN;
-    case ST:
-      return TAKEN;
-    default:
-      printf("Warning: Undefined state of entry in Alpha21264 GPT!\n");
-      return NOTTAKEN;
-    }
-  }
-  else
-  {
-    printf("Warning: Undefined state of entry in Alpha21264 CT!\n");
-    return NOTTAKEN;
-  }
+  l->index[0] = lht_index;
+  l->index[1] = lpt_index;
+  l->index[2] = gpt_index;
+  l->index[3] = ct_index;
+
+  // SN/WN in the CT choose the local prediction, WT/ST the global one
+  uint8_t local = counter_prediction(get_counter(&p->lpt, lpt_index, cfg->packed));
+  uint8_t global = counter_prediction(get_counter(&p->gpt, gpt_index, cfg->packed));
+  l->provider = counter_prediction(get_counter(&p->ct, ct_index, cfg->packed));
+  return l->prediction = l->provider ? global : local;
 }
 
-void train_alpha21264(uint32_t pc, uint8_t outcome)
+static void update_alpha21264(struct alpha21264 *p, const struct alpha21264_config *cfg, uint8_t outcome, const struct predictor_token *l)
 {
-  // get lower ghistoryBits of pc
-  uint32_t lht_entries = 1 << alpha21264LIndexBits;
-  uint32_t lht_index = pc & (lht_entries - 1);
-
-  uint32_t lpt_entries = 1 << alpha21264LhistoryBits;
-  uint32_t lpt_index = lht_alpha21264[lht_index] & (lpt_entries - 1);
-
-  uint32_t gpt_entries = 1 << alpha21264GhistoryBits;
-  uint32_t gpt_index = ghistory & (gpt_entries - 1);
-
-  uint32_t ct_entries = 1 << alpha21264ChoiceBits;
-  uint32_t ct_index = ghistory & (ct_entries - 1);
+  uint32_t lht_index = l->index[0];
+  uint32_t lpt_index = l->index[1];
+  uint32_t gpt_index = l->index[2];
+  uint32_t ct_index = l->index[3];
 
-  uint8_t lpt_outcome;
-  uint8_t gpt_outcome;
+  uint8_t lpt = get_counter(&p->lpt, lpt_index, cfg->packed);
+  uint8_t gpt = get_counter(&p->gpt, gpt_index, cfg->packed);
+  uint8_t ct = get_counter(&p->ct, ct_index, cfg->packed);
+  uint8_t lpt_outcome = counter_prediction(lpt);
+  uint8_t gpt_outcome = counter_prediction(gpt);
 
   // Update state of entry in bht based on outcome
-  switch (lpt_alpha21264[lpt_index])
-  {
-  case WN:
-    lpt_alpha21264[lpt_index] = (outcome == TAKEN) ? WT : SN;
-    lpt_outcome = NOTTAKEN;
-    break;
-  case SN:
-    lpt_alpha21264[lpt_index] = (outcome == TAKEN) ? WN : SN;
-    lpt_outcome = NOTTAKEN;
-    break;
-  case WT:
-    lpt_alpha21264[lpt_index] = (outcome == TAKEN) ? ST : WN;
-    lpt_outcome = TAKEN;
-    break;
-  case ST:
-    lpt_alpha21264[lpt_index] = (outcome == TAKEN) ? ST : WT;
-    lpt_outcome = TAKEN;
-    break;
-  default:
-    printf("Warning: Undefined state of entry in GSHARE BHT!\n");
-  }
-
-  switch (gpt_alpha21264[gpt_index])
-  {
-  case WN:
-    gpt_alpha21264[gpt_index] = (outcome == TAKEN) ? WT : SN;
-    gpt_outcome = NOTTAKEN;
-    break;
-  case SN:
-    gpt_alpha21264[gpt_index] = (outcome == TAKEN) ? WN : SN;
-    gpt_outcome = NOTTAKEN;
-    break;
-  case WT:
-    gpt_alpha21264[gpt_index] = (outcome == TAKEN) ? ST : WN;
-    gpt_outcome = TAKEN;
-    break;
-  case ST:
-    gpt_alpha21264[gpt_index] = (outcome == TAKEN) ? ST : WT;
-    gpt_outcome = TAKEN;
-    break;
-  default:
-    printf("Warning: Undefined state of entry in GSHARE BHT!\n");
-  }
-
-  if ((lpt_alpha21264[lpt_index] == ST || lpt_alpha21264[lpt_index] == WT) ^ (gpt_alpha21264[gpt_index] == ST || gpt_alpha21264[gpt_index] == WT))
-  {
-    switch (ct_alpha21264[ct_index])
-    {
-    case WN:
-      ct_alpha21264[ct_index] = (outcome == lpt_outcome) ? SN : WT;
-      break;
-    case SN:
-      ct_alpha21264[ct_index] = (outcome == lpt_outcome) ? SN : WN;
-      break;
-    case WT:
-      ct_alpha21264[ct_index] = (outcome == gpt_outcome) ? ST : WN;
-      break;
-    case ST:
-      ct_alpha21264[ct_index] = (outcome == gpt_outcome) ? ST : WT;
-      break;
-    default:
-      printf("Warning: Undefined state of entry in GSHARE BHT!\n");
-    }
-  }
+  lpt = counter_step(lpt, outcome, ST);
+  gpt = counter_step(gpt, outcome, ST);
+  set_counter(&p->lpt, lpt_index, lpt, cfg->packed);
+  set_counter(&p->gpt, gpt_index, gpt, cfg->packed);
+
+  // Train the CT when the updated tables disagree
+  uint8_t disagree = counter_prediction(lpt) ^ counter_prediction(gpt);
+  set_counter(&p->ct, ct_index, choice_step(ct, disagree, outcome, lpt_outcome, gpt_outcome), cfg->packed);
 
   // Update history register
-  lht_alpha21264[lht_index] = ((lht_alpha21264[lht_index] << 1) | outcome);
-  ghistory = ((ghistory << 1) | outcome);
+  set_history(&p->lht, lht_index, (get_history(&p->lht, lht_index) << 1) | outcome);
+  p->ghistory = ((p->ghistory << 1) | outcome);
 }
 
-void cleanup_alpha21264()
+void cleanup_alpha21264(struct alpha21264 *p)
 {
-  free(lht_alpha21264);
-  free(lpt_alpha21264);
-  free(gpt_alpha21264);
-  free(ct_alpha21264);
+  cleanup_history_table(&p->lht);
+  cleanup_counter_table(&p->lpt);
+  cleanup_counter_table(&p->gpt);
+  cleanup_counter_table(&p->ct);
 }
 
 // Custom-tage function
-void init_tage()
+void init_tage(struct tage *p, const struct tage_config *cfg)
 {
-  for (size_t i = 0; i < TAGE_GHR_SIZE_QW; i++)
+  p->cfg = *cfg;
+  p->rng = 0x2545f4914f6cdd1dULL;
+
+  // Added in the order of the TAGE_FOLD_* indexes
+  history_init(&p->hist);
+  for (size_t i = 0; i < TAGE_COMPONENTS; i++)
   {
-    tage_ghr[i] = 0;
+    history_add_fold(&p->hist, p->cfg.used_length[i], p->cfg.Ti_PC);
   }
-
-  uint32_t T0_entries = 1 << T0_PC;
-  T0 = (struct saturating_counter *)malloc(T0_entries * sizeof(struct saturating_counter));
-  for (size_t i = 0; i < T0_entries; i++)
+  for (size_t i = 0; i < TAGE_COMPONENTS; i++)
+  {
+    history_add_fold(&p->hist, p->cfg.used_length[i], p->cfg.tag_bit);
+  }
+  for (size_t i = 0; i < TAGE_COMPONENTS; i++)
   {
-    T0[i].bits = 2;
-    T0[i].ctr = WT;
+    history_add_fold(&p->hist, p->cfg.used_length[i], p->cfg.tag_bit);
   }
 
-  uint32_t Ti_entries = 1 << Ti_PC;
-  for (size_t i = 0; i < COMPONENT_NUM; i++)
+  uint32_t T0_entries = 1 << p->cfg.T0_PC;
+  p->T0 = (uint8_t *)calloc(T0_entries, sizeof(uint8_t));
+  memset(p->T0, TAGE_T0_INIT, T0_entries);
+
+  uint32_t Ti_entries = 1 << p->cfg.Ti_PC;
+  p->entries = (tage_entry *)calloc((size_t)TAGE_COMPONENTS * Ti_entries, sizeof(tage_entry));
+  for (size_t i = 0; i < TAGE_COMPONENTS * Ti_entries; i++)
   {
-    tage_component[i] = (struct tage_component_entry *)calloc(Ti_entries, sizeof(struct tage_component_entry));
-    for (size_t j = 0; j < Ti_entries; j++)
-    {
-      tage_component[i][j].pred.bits = 3;
-      tage_component[i][j].pred.ctr = 4;
+    p->entries[i] = tage_make_entry(0, 0, TAGE_CTR_INIT);
+  }
+  for (size_t i = 0; i < TAGE_COMPONENTS; i++)
+  {
+    p->component[i] = p->entries + i * Ti_entries;
+  }
+
+  p->use_alt = TAGE_USE_ALT_INIT;
 
-      tage_component[i][j].u.bits = 2;
-      tage_component[i][j].u.ctr = 0;
+  p->loop = NULL;
+  p->with_loop = -1;
+  if (p->cfg.loopBits)
+  {
+    p->loop = (struct tage_loop *)calloc((size_t)1 << p->cfg.loopBits, sizeof(struct tage_loop));
+  }
 
-      tage_component[i][j].tag = 0;
+  memset(p->sc, 0, sizeof(p->sc));
+  p->sc_theta = TAGE_SC_THETA;
+  p->sc_tc = 0;
+  if (p->cfg.scBits)
+  {
+    for (int j = 0; j < TAGE_SC_TABLES; j++)
+    {
+      p->sc[j] = (int8_t *)calloc((size_t)1 << p->cfg.scBits, sizeof(int8_t));
+    }
+    for (int j = 1; j < TAGE_SC_TABLES; j++)
+    {
+      history_add_fold(&p->hist, tage_sc_length[j], p->cfg.scBits);
     }
-    csr0[i].bits = Ti_PC;
-    csr0[i].r = 0;
-    csr1[i].bits = tag_bit;
-    csr1[i].r = 0;
-    csr2[i].bits = tag_bit;
-    csr2[i].r = 0;
   }
 }
 
-uint8_t tage_predict(uint32_t pc)
+// A provider that was just allocated, its prediction is no better than
+// the alternate one
+static inline uint8_t tage_weak_new(tage_entry e)
 {
-  uint32_t Ti_mask = (1 << Ti_PC) - 1;
-  uint32_t Ti_index;
-  uint64_t tag;
-  uint32_t tag_mask = (1 << tag_bit) - 1;
-  for (int i = COMPONENT_NUM - 1; i >= 0; i--)
+  return tage_u(e) == 0 && (tage_ctr(e) == TAGE_CTR_INIT || tage_ctr(e) == TAGE_CTR_INIT - 1);
+}
+
+// Look the branch up in the loop predictor, which overrides 'pred'
+// once its entry is confident and it has been more right than TAGE
+static uint8_t lookup_tage_loop(struct tage *p, const struct tage_config *cfg, uint32_t pc,
+                                struct predictor_token *l, uint8_t pred)
+{
+  l->loop = pc & ((1 << (cfg->loopBits + TAGE_LOOP_TAG_BITS)) - 1);
+  struct tage_loop *e = &p->loop[l->loop & ((1 << cfg->loopBits) - 1)];
+  if (e->tag != l->loop >> cfg->loopBits)
   {
-    Ti_index = (pc >> tage_component_used_length[i]) ^ pc ^ csr0[i].r;
-    Ti_index = Ti_index & Ti_mask;
-    tag = pc ^ csr1[i].r ^ (csr2[i].r << 1);
-    tag = tag & tag_mask;
-    if (tage_component[i][Ti_index].tag == tag)
+    return pred;
+  }
+
+  // The run ends after 'past' iterations
+  uint8_t loop = e->cur + 1 == e->past ? !e->dir : e->dir;
+  l->aux |= TAGE_AUX_LOOP_HIT | (loop ? TAGE_AUX_LOOP_PRED : 0);
+  if (e->conf == TAGE_LOOP_CONF_MAX)
+  {
+    l->aux |= TAGE_AUX_LOOP_VALID;
+    if (p->with_loop >= 0)
     {
-      return get_saturating_counter(&tage_component[i][Ti_index].pred);
+      return loop;
     }
   }
-  uint32_t T0_entries = 1 << T0_PC;
-  uint32_t T0_index = pc & (T0_entries - 1);
-  return get_saturating_counter(&T0[T0_index]);
+  return pred;
 }
 
-void train_tage(uint32_t pc, uint8_t outcome)
+static void update_tage_loop(struct tage *p, const struct tage_config *cfg, uint8_t outcome,
+                             const struct predictor_token *l)
 {
-  uint8_t pred_result;
+  struct tage_loop *e = &p->loop[l->loop & ((1 << cfg->loopBits) - 1)];
+  uint8_t tage = (l->aux & TAGE_AUX_TAGE) != 0;
+  uint8_t loop = (l->aux & TAGE_AUX_LOOP_PRED) != 0;
 
-  uint8_t propred = 0;
-  uint32_t Ti_indexes[COMPONENT_NUM];
-  uint32_t Ti_tags[COMPONENT_NUM];
-  uint8_t altpred = 0;
-
-  uint8_t not_found = 1;
-  uint32_t Ti_mask = (1 << Ti_PC) - 1;
-  uint32_t Ti_index;
-  uint32_t tag;
-  uint32_t tag_mask = (1 << tag_bit) - 1;
-  for (int i = COMPONENT_NUM - 1; i >= 0; i--)
+  if (!(l->aux & TAGE_AUX_LOOP_HIT))
   {
-    Ti_index = (pc >> tage_component_used_length[i]) ^ pc ^ csr0[i].r;
-    Ti_index = Ti_index & Ti_mask;
-    Ti_indexes[i] = Ti_index;
-    tag = pc ^ csr1[i].r ^ (csr2[i].r << 1);
-    tag = tag & tag_mask;
-    Ti_tags[i] = tag;
-    if (tage_component[i][Ti_index].tag == tag)
+    // Allocate on a TAGE misprediction, the branch may be a loop exit
+    if (tage != outcome)
     {
-      if (propred == 0)
+      if (e->age == 0)
       {
-        propred = i;
-        not_found = 0;
-        pred_result = get_saturating_counter(&tage_component[i][Ti_index].pred);
+        e->tag = l->loop >> cfg->loopBits;
+        e->dir = !outcome;
+        e->past = 0;
+        e->cur = 0;
+        e->conf = 0;
+        e->age = TAGE_LOOP_AGE_MAX;
       }
-      else if (altpred == 0)
+      else
       {
-        altpred = i;
-        break;
+        e->age--;
       }
     }
-  }
-  if (not_found)
-  {
-    uint32_t T0_entries = 1 << T0_PC;
-    uint32_t T0_index = pc & (T0_entries - 1);
-    pred_result = get_saturating_counter(&T0[T0_index]);
+    return;
   }
 
-  if (propred != 0 && propred != altpred)
+  if (l->aux & TAGE_AUX_LOOP_VALID)
   {
-    if (pred_result == outcome)
+    if (loop != tage)
     {
-      inc_saturating_counter(&tage_component[propred][Ti_indexes[propred]].u);
+      p->with_loop += loop == outcome ? (p->with_loop < TAGE_WITH_LOOP_MAX) : -(p->with_loop > TAGE_WITH_LOOP_MIN);
     }
-    else
+    if (loop != outcome)
+    {
+      // Not a loop after all, free the entry
+      e->past = 0;
+      e->cur = 0;
+      e->conf = 0;
+      e->age = 0;
+      return;
+    }
+    if (loop != tage && e->age < TAGE_LOOP_AGE_MAX)
     {
-      dec_saturating_counter(&tage_component[propred][Ti_indexes[propred]].u);
+      e->age++;
     }
   }
 
-  if (pred_result != outcome)
+  e->cur = (e->cur + 1) & TAGE_LOOP_ITER_MASK;
+  if (e->cur > e->past)
+  {
+    e->conf = 0;
+    e->past = 0;
+  }
+  if (outcome != e->dir)
   {
-    dec_saturating_counter(&tage_component[propred][Ti_indexes[propred]].pred);
-    if (propred != COMPONENT_NUM - 1)
+    if (e->cur == e->past)
     {
-      int comp_num = 0;
-      not_found = 1;
-      for (size_t i = propred + 1; i < COMPONENT_NUM; i++)
+      e->conf += e->conf < TAGE_LOOP_CONF_MAX;
+      if (e->past < 3)
       {
-        if (tage_component[i][Ti_indexes[i]].u.ctr == 0)
-        {
-          not_found = 0;
-          comp_num++;
-        }
-      }
-      if (comp_num > 0)
-      {
-        comp_num = (1 << comp_num) - 1;
-        int r = rand() % comp_num;
-        for (size_t i = propred + 1; i < COMPONENT_NUM; i++)
-        {
-          if (tage_component[i][Ti_indexes[i]].u.ctr == 0)
-          {
-            if ((r & 1) == 0)
-            {
-              tage_component[i][Ti_indexes[i]].pred.ctr = 4; // hard code
-              tage_component[i][Ti_indexes[i]].tag = Ti_tags[i];
-              break;
-            }
-            else
-            {
-              r = r >> 1;
-            }
-          }
-        }
+        // Too short to be worth an entry
+        e->dir = outcome;
+        e->past = 0;
+        e->conf = 0;
+        e->age = 0;
       }
     }
-    if (not_found)
+    else
     {
-      for (size_t i = propred + 1; i < COMPONENT_NUM; i++)
-      {
-        dec_saturating_counter(&tage_component[i][Ti_indexes[i]].u);
-      }
+      // Learn the length of the first run, forget it on any other
+      e->past = e->past == 0 ? e->cur : 0;
+      e->conf = 0;
     }
-  }
-
-  // Update history register and csr
-  update_tage_ghr(outcome);
-  for (size_t i = 0; i < COMPONENT_NUM; i++)
-  {
-    update_csr(&csr0[i], tage_component_used_length[i]);
-    update_csr(&csr1[i], tage_component_used_length[i]);
-    update_csr(&csr2[i], tage_component_used_length[i]);
+    e->cur = 0;
   }
 }
 
-void cleanup_tage()
+// Correct 'pred' from the SC tables. 'conf' is the confidence of the
+// prediction, 0 (weak) to 3 (strong).
+static uint8_t lookup_tage_sc(struct tage *p, const struct tage_config *cfg, uint32_t pc,
+                              struct predictor_token *l, uint8_t pred, int conf)
 {
-  free(T0);
+  uint32_t mask = (1 << cfg->scBits) - 1;
+  int sum = 0;
 
-  for (size_t i = 0; i < COMPONENT_NUM; i++)
+  l->sc_index[0] = ((pc << 1) | pred) & mask;
+  for (int j = 1; j < TAGE_SC_TABLES; j++)
   {
-    free(tage_component[i]);
+    l->sc_index[j] = (pc ^ (pc >> cfg->scBits) ^ p->hist.r[TAGE_FOLD_SC(j)]) & mask;
+  }
+  for (int j = 0; j < TAGE_SC_TABLES; j++)
+  {
+    sum += 2 * p->sc[j][l->sc_index[j]] + 1;
   }
-}
-
-int bimode_nt_ghistoryBits = 11;
-int bimode_t_ghistoryBits = 11;
-int ct_PCBits = 11;
-
-uint8_t *pht_nt_bimode;
-uint8_t *pht_t_bimode;
-uint8_t *ct_bimode;
-
-// bimode functions
-void init_bimode()
-{
-  int pht_nt_entries = 1 << bimode_nt_ghistoryBits;                    // 2^10 entries in LHT (Local histort table)
-  int pht_t_entries = 1 << bimode_t_ghistoryBits;                      // 2^11 entries in LPT (Local prediction table)
-  int choice_entries = 1 << ct_PCBits;                                 // 2^12 entries in CT (Choice prediction table)
-  pht_nt_bimode = (uint8_t *)malloc(pht_nt_entries * sizeof(uint8_t)); // 2^11 * 2 (bit counter) = 4 * 2^10 bits
-  pht_t_bimode = (uint8_t *)malloc(pht_t_entries * sizeof(uint8_t));   // 2^12 * 2 (bit counter) = 8 * 2^10 bits
-  ct_bimode = (uint8_t *)malloc(choice_entries * sizeof(uint8_t));     // 2^12 * 2 (bit counter) = 8 * 2^10 bits
-                                                                       // total: (11 + 4 + 8 + 8) * 2^10 bits = 31 * 2^10 bits = 31744 bits < 32Kbits = 32768 bits
 
-  memset(pht_nt_bimode, WN, pht_nt_entries);
-  memset(pht_t_bimode, WN, pht_t_entries);
-  memset(ct_bimode, WN, choice_entries);
+  // The prediction votes for itself with its confidence
+  int vote = 8 * (conf + 1);
+  sum += pred ? vote : -vote;
 
-  ghistory = 0;
+  l->sc_sum = sum;
+  return sum >= 0 ? TAKEN : NOTTAKEN;
 }
 
-uint8_t bimode_predict(uint32_t pc)
+static void update_tage_sc(struct tage *p, const struct tage_config *cfg, uint8_t outcome,
+                           const struct predictor_token *l)
 {
-  // get lower ghistoryBits of pc
-  uint32_t pht_nt_entries = 1 << bimode_nt_ghistoryBits;
-  uint32_t pc_lower_bits_nt = pc & (pht_nt_entries - 1);
-  uint32_t ghistory_lower_bits_nt = ghistory & (pht_nt_entries - 1);
-  uint32_t index_nt = pc_lower_bits_nt ^ ghistory_lower_bits_nt;
-
-  uint32_t pht_t_entries = 1 << bimode_t_ghistoryBits;
-  uint32_t pc_lower_bits_t = pc & (pht_t_entries - 1);
-  uint32_t ghistory_lower_bits_t = ghistory & (pht_t_entries - 1);
-  uint32_t index_t = pc_lower_bits_t ^ ghistory_lower_bits_t;
-
-  uint32_t ct_entries = 1 << ct_PCBits;
-  uint32_t ct_index = ghistory & (ct_entries - 1);
+  int sum = l->sc_sum;
+  uint8_t sc = sum >= 0;
 
-  if (ct_bimode[ct_index] >= SN && ct_bimode[ct_index] <= WN)
+  if (sc != outcome || abs(sum) < p->sc_theta)
   {
-    switch (pht_nt_bimode[index_nt])
+    for (int j = 0; j < TAGE_SC_TABLES; j++)
     {
-    case WN:
-      return NOTTAKEN;
-    case SN:
-      return NOTTAKEN;
-    case WT:
-      return TAKEN;
-    case ST:
-      return TAKEN;
-    default:
-      printf("Warning: Undefined state of entry in Bimode PHT NT!\n");
-      return NOTTAKEN;
+      int8_t *c = &p->sc[j][l->sc_index[j]];
+      *c += outcome ? (*c < TAGE_SC_CTR_MAX) : -(*c > TAGE_SC_CTR_MIN);
     }
   }
-  else if (ct_bimode[ct_index] >= WT && ct_bimode[ct_index] <= ST)
+
+  // Raise the threshold while the SC mispredicts and lower it while it
+  // trains on correct predictions
+  if (sc != outcome)
   {
-    switch (pht_t_bimode[index_t])
+    if (++p->sc_tc >= TAGE_SC_TC_MAX)
     {
-    case WN:
-      return NOTTAKEN;
-    case SN:
-      return NOTTAKEN;
-    case WT:
-      return TAKEN;
-    case ST:
-      return TAKEN;
-    default:
-      printf("Warning: Undefined state of entry in Bimode PHT T!\n");
-      return NOTTAKEN;
+      p->sc_theta++;
+      p->sc_tc = 0;
     }
   }
-  else
+  else if (abs(sum) < p->sc_theta)
   {
-    printf("Warning: Undefined state of entry in Bimode CT!\n");
-    return NOTTAKEN;
+    if (--p->sc_tc <= -TAGE_SC_TC_MAX)
+    {
+      p->sc_theta -= p->sc_theta > 1;
+      p->sc_tc = 0;
+    }
   }
 }
 
-void train_bimode(uint32_t pc, uint8_t outcome)
+static uint8_t lookup_tage(struct tage *p, const struct tage_config *cfg, uint32_t pc, struct predictor_token *l)
 {
-  // get lower ghistoryBits of pc
-  uint32_t pht_nt_entries = 1 << bimode_nt_ghistoryBits;
-  uint32_t pc_lower_bits_nt = pc & (pht_nt_entries - 1);
-  uint32_t ghistory_lower_bits_nt = ghistory & (pht_nt_entries - 1);
-  uint32_t index_nt = pc_lower_bits_nt ^ ghistory_lower_bits_nt;
-
-  uint32_t pht_t_entries = 1 << bimode_t_ghistoryBits;
-  uint32_t pc_lower_bits_t = pc & (pht_t_entries - 1);
-  uint32_t ghistory_lower_bits_t = ghistory & (pht_t_entries - 1);
-  uint32_t index_t = pc_lower_bits_t ^ ghistory_lower_bits_t;
-
-  uint32_t ct_entries = 1 << ct_PCBits;
-  uint32_t ct_index = ghistory & (ct_entries - 1);
-
-  uint8_t wrong = 0;
-
-  if (ct_bimode[ct_index] >= SN && ct_bimode[ct_index] <= WN)
-  {
-    // Update state of entry in bht based on outcome
-    switch (pht_nt_bimode[index_nt])
-    {
-    case WN:
-      pht_nt_bimode[index_nt] = (outcome == TAKEN) ? WT : SN;
-      wrong = 1;
-      break;
-    case SN:
-      pht_nt_bimode[index_nt] = (outcome == TAKEN) ? WN : SN;
-      wrong = 1;
-      break;
-    case WT:
-      pht_nt_bimode[index_nt] = (outcome == TAKEN) ? ST : WN;
-      break;
-    case ST:
-      pht_nt_bimode[index_nt] = (outcome == TAKEN) ? ST : WT;
-      break;
-    default:
-      printf("Warning: Undefined state of entry in GSHARE BHT!\n");
-    }
-  }
-  else if (ct_bimode[ct_index] >= WT && ct_bimode[ct_index] <= ST)
+  uint32_t Ti_mask = (1 << cfg->Ti_PC) - 1;
+  uint32_t Ti_index;
+  uint32_t tag;
+  uint32_t tag_mask = (1 << cfg->tag_bit) - 1;
+
+  // Search from the longest history down. Training only touches the
+  // provider, the alternate and the components above them, so the
+  // search stops there.
+  l->provider = -1;
+  l->alt = -1;
+  for (int i = TAGE_COMPONENTS - 1; i >= 0; i--)
   {
-    // Update state of entry in bht based on outcome
-    switch (pht_t_bimode[index_t])
+    // The lengths go past the width of the PC, the shift wraps at 32
+    // as the x86 shift instructions the results were made with do
+    Ti_index = (pc >> (cfg->used_length[i] & 31)) ^ pc ^ p->hist.r[TAGE_FOLD_INDEX(i)];
+    Ti_index = Ti_index & Ti_mask;
+    l->index[i] = Ti_index;
+    tag = pc ^ p->hist.r[TAGE_FOLD_TAG1(i)] ^ (p->hist.r[TAGE_FOLD_TAG2(i)] << 1);
+    tag = tag & tag_mask;
+    l->tag[i] = tag;
+    if (tage_tag(p->component[i][Ti_index]) == tag)
     {
-    case WN:
-      pht_t_bimode[index_t] = (outcome == TAKEN) ? WT : SN;
-      wrong = 1;
-      break;
-    case SN:
-      pht_t_bimode[index_t] = (outcome == TAKEN) ? WN : SN;
-      wrong = 1;
-      break;
-    case WT:
-      pht_t_bimode[index_t] = (outcome == TAKEN) ? ST : WN;
-      break;
-    case ST:
-      pht_t_bimode[index_t] = (outcome == TAKEN) ? ST : WT;
+      if (l->provider < 0)
+      {
+        l->provider = i;
+        if (cfg->altpred)
+        {
+          continue;
+        }
+      }
+      else
+      {
+        l->alt = i;
+      }
       break;
-    default:
-      printf("Warning: Undefined state of entry in GSHARE BHT!\n");
     }
   }
-  else
+  uint32_t T0_entries = 1 << cfg->T0_PC;
+  uint32_t T0_index = pc & (T0_entries - 1);
+  l->index[TAGE_COMPONENTS] = T0_index;
+
+  // The base predictor provides when no component hits and is the
+  // alternate when only one does
+  uint8_t T0 = p->T0[T0_index];
+  uint8_t alt = counter_prediction(T0);
+  int conf = (T0 == SN || T0 == ST) ? 2 : 0;
+  if (l->alt >= 0)
   {
-    printf("Warning: Undefined state of entry in Bimode CT!\n");
+    alt = tage_ctr(p->component[l->alt][l->index[l->alt]]) >> (TAGE_CTR_BITS - 1);
   }
-  if (wrong == 1 | ct_bimode[ct_index] == outcome)
+
+  uint8_t pred = alt;
+  if (l->provider >= 0)
   {
-    switch (ct_bimode[ct_index])
+    tage_entry e = p->component[l->provider][l->index[l->provider]];
+    pred = tage_ctr(e) >> (TAGE_CTR_BITS - 1);
+    conf = abs(2 * tage_ctr(e) - TAGE_CTR_MAX) >> 1;
+    if (cfg->altpred && tage_weak_new(e) && p->use_alt >= TAGE_USE_ALT_INIT)
     {
-    case WN:
-      ct_bimode[ct_index] = (outcome == TAKEN) ? WT : SN;
-      break;
-    case SN:
-      ct_bimode[ct_index] = (outcome == TAKEN) ? WN : SN;
-      break;
-    case WT:
-      ct_bimode[ct_index] = (outcome == TAKEN) ? ST : WN;
-      break;
-    case ST:
-      ct_bimode[ct_index] = (outcome == TAKEN) ? ST : WT;
-      break;
-    default:
-      printf("Warning: Undefined state of entry in Bimode CT!\n");
+      pred = alt;
+      conf = 0;
     }
   }
-  ghistory = ((ghistory << 1) | outcome);
-}
+  l->aux = (pred ? TAGE_AUX_TAGE : 0) | (alt ? TAGE_AUX_ALT : 0);
 
-void cleanup_bimode()
+  if (cfg->loopBits)
+  {
+    uint8_t loop = lookup_tage_loop(p, cfg, pc, l, pred);
+    conf = loop != pred || (l->aux & TAGE_AUX_LOOP_VALID) ? 3 : conf;
+    pred = loop;
+  }
+  l->aux |= pred ? TAGE_AUX_INTER : 0;
+
+  if (cfg->scBits)
+  {
+    pred = lookup_tage_sc(p, cfg, pc, l, pred, conf);
+  }
+  return l->prediction = pred;
+}
+
+// Give the branch an entry in one of the components from 'first' up
+// whose u is 0, picked at random with the shorter histories more
+// likely. If there is none, their u are aged instead.
+static void tage_allocate(struct tage *p, int first, const struct predictor_token *l, uint8_t ctr)
 {
-  free(pht_nt_bimode);
-  free(pht_t_bimode);
-  free(ct_bimode);
+  const uint32_t *Ti_indexes = l->index;
+  int comp_num = 0;
+
+  for (size_t i = first; i < TAGE_COMPONENTS; i++)
+  {
+    if (tage_u(p->component[i][Ti_indexes[i]]) == 0)
+    {
+      comp_num++;
+    }
+  }
+  if (comp_num > 0)
+  {
+    comp_num = (1 << comp_num) - 1;
+    int r = tage_rand(p) % comp_num;
+    for (size_t i = first; i < TAGE_COMPONENTS; i++)
+    {
+      if (tage_u(p->component[i][Ti_indexes[i]]) == 0)
+      {
+        if ((r & 1) == 0)
+        {
+          p->component[i][Ti_indexes[i]] = tage_make_entry(l->tag[i], 0, ctr);
+          break;
+        }
+        else
+        {
+          r = r >> 1;
+        }
+      }
+    }
+  }
+  else
+  {
+    for (size_t i = first; i < TAGE_COMPONENTS; i++)
+    {
+      tage_step_u(&p->component[i][Ti_indexes[i]], 0);
+    }
+  }
 }
 
-// Cust
-uint64_t *lht_cust;
-uint8_t *lpt_cust;
+// The original update: the base predictor is never trained, a
+// misprediction only ever decrements the provider (or component 0
+// without one) and every allocation starts weakly taken
+static void train_tage_original(struct tage *p, uint8_t outcome, const struct predictor_token *l)
+{
+  uint8_t pred_result = (l->aux & TAGE_AUX_TAGE) != 0;
 
-uint8_t *gpt_cust;
+  // Component 0 doubles as "no provider" below, as it always has
+  uint8_t propred = l->provider > 0 ? l->provider : 0;
+  const uint32_t *Ti_indexes = l->index;
 
-uint8_t *ct_cust;
+  if (propred != 0)
+  {
+    tage_step_u(&p->component[propred][Ti_indexes[propred]], pred_result == outcome);
+  }
 
-int custLhistoryBits = 10; // Number of bits of saturating counter used for Local prediction
-int custLIndexBits = 10;   // Number of Program counter bits used for Local history table
-int custChoiceBits = 12;   // Number of Path history bits used for Choice prediction
+  if (pred_result != outcome)
+  {
+    tage_step_ctr(&p->component[propred][Ti_indexes[propred]], 0);
+    if (propred != TAGE_COMPONENTS - 1)
+    {
+      tage_allocate(p, propred + 1, l, TAGE_CTR_INIT);
+    }
+  }
+}
 
-// cust functions
-void init_cust()
+// The TAGE update with the alternate prediction
+static void train_tage_altpred(struct tage *p, uint8_t outcome, const struct predictor_token *l)
+{
+  uint8_t pred = (l->aux & TAGE_AUX_TAGE) != 0;
+  uint8_t alt = (l->aux & TAGE_AUX_ALT) != 0;
+  uint8_t *T0 = &p->T0[l->index[TAGE_COMPONENTS]];
+
+  if (l->provider >= 0)
+  {
+    tage_entry *e = &p->component[l->provider][l->index[l->provider]];
+    uint8_t provpred = tage_ctr(*e) >> (TAGE_CTR_BITS - 1);
+
+    if (provpred != alt)
+    {
+      if (tage_weak_new(*e))
+      {
+        p->use_alt = counter_step(p->use_alt, alt == outcome, TAGE_USE_ALT_MAX);
+      }
+      tage_step_u(e, provpred == outcome);
+    }
+
+    // Until the provider proves useful the alternate keeps learning
+    if (tage_u(*e) == 0)
+    {
+      if (l->alt >= 0)
+      {
+        tage_step_ctr(&p->component[l->alt][l->index[l->alt]], outcome);
+      }
+      else
+      {
+        *T0 = counter_step(*T0, outcome, ST);
+      }
+    }
+    tage_step_ctr(e, outcome);
+  }
+  else
+  {
+    *T0 = counter_step(*T0, outcome, ST);
+  }
+
+  // New entries start weak in the direction of the outcome
+  if (pred != outcome && l->provider < TAGE_COMPONENTS - 1)
+  {
+    tage_allocate(p, l->provider + 1, l, outcome ? TAGE_CTR_INIT : TAGE_CTR_INIT - 1);
+  }
+}
+
+static void update_tage(struct tage *p, const struct tage_config *cfg, uint8_t outcome, const struct predictor_token *l)
+{
+  if (cfg->loopBits)
+  {
+    update_tage_loop(p, cfg, outcome, l);
+  }
+  if (cfg->scBits)
+  {
+    update_tage_sc(p, cfg, outcome, l);
+  }
+  if (cfg->altpred)
+  {
+    train_tage_altpred(p, outcome, l);
+  }
+  else
+  {
+    train_tage_original(p, outcome, l);
+  }
+
+  // Update the global history and all of its folds at once
+  history_push(&p->hist, outcome);
+}
+
+void cleanup_tage(struct tage *p)
+{
+  free(p->T0);
+  free(p->entries);
+  free(p->loop);
+  for (int j = 0; j < TAGE_SC_TABLES; j++)
+  {
+    free(p->sc[j]);
+  }
+}
+
+// bimode functions
+void init_bimode(struct bimode *p, const struct bimode_config *cfg)
 {
-  int lht_entries = 1 << custLIndexBits;                         // 2^10 entries in LHT (Local histort table)
-  int lpt_entries = 1 << custLhistoryBits;                       // 2^10 entries in LPT (Local prediction table)
-  int choice_entries = 1 << custChoiceBits;                      // 2^12 entries in CT (Choice prediction table)
-  lht_cust = (uint64_t *)calloc(lht_entries, sizeof(uint64_t));  // 2^10 * 10 (bit counter) = 10 * 2^10 bits
-  lpt_cust = (uint8_t *)malloc(lpt_entries * sizeof(uint8_t));   // 2^10 * 2 (bit counter) = 2 * 2^10 bits
-  ct_cust = (uint8_t *)malloc(choice_entries * sizeof(uint8_t)); // 2^12 * 2 (bit counter) = 8 * 2^10 bits
+  p->cfg = *cfg;
+  int pht_nt_entries = 1 << p->cfg.nt_ghistoryBits;               // 2^10 entries in LHT (Local histort table)
+  int pht_t_entries = 1 << p->cfg.t_ghistoryBits;                 // 2^11 entries in LPT (Local prediction table)
+  int choice_entries = 1 << p->cfg.ct_PCBits;                     // 2^12 entries in CT (Choice prediction table)
+  init_counter_table(&p->pht_nt, pht_nt_entries, p->cfg.packed);  // 2^11 * 2 (bit counter) = 4 * 2^10 bits
+  init_counter_table(&p->pht_t, pht_t_entries, p->cfg.packed);    // 2^12 * 2 (bit counter) = 8 * 2^10 bits
+  init_counter_table(&p->ct, choice_entries, p->cfg.packed);      // 2^12 * 2 (bit counter) = 8 * 2^10 bits
+                                                                  // total: (11 + 4 + 8 + 8) * 2^10 bits = 31 * 2^10 bits = 31744 bits < 32Kbits = 32768 bits
+
+  fill_counter_table(&p->pht_nt, pht_nt_entries, WN);
+  fill_counter_table(&p->pht_t, pht_t_entries, WN);
+  fill_counter_table(&p->ct, choice_entries, WN);
+
+  p->ghistory = 0;
+}
+
+// Bimode is also the global half of cust, so its lookup state lives at
+// l->index[base...] to leave room for the caller's own indices
+static uint8_t lookup_bimode(struct bimode *p, const struct bimode_config *cfg, uint32_t pc, struct predictor_token *l, int base)
+{
+  // get lower ghistoryBits of pc
+  uint32_t pht_nt_entries = 1 << cfg->nt_ghistoryBits;
+  uint32_t pc_lower_bits_nt = pc & (pht_nt_entries - 1);
+  uint32_t ghistory_lower_bits_nt = p->ghistory & (pht_nt_entries - 1);
+  uint32_t index_nt = pc_lower_bits_nt ^ ghistory_lower_bits_nt;
+
+  uint32_t pht_t_entries = 1 << cfg->t_ghistoryBits;
+  uint32_t pc_lower_bits_t = pc & (pht_t_entries - 1);
+  uint32_t ghistory_lower_bits_t = p->ghistory & (pht_t_entries - 1);
+  uint32_t index_t = pc_lower_bits_t ^ ghistory_lower_bits_t;
+
+  uint32_t ct_entries = 1 << cfg->ct_PCBits;
+  uint32_t ct_index = p->ghistory & (ct_entries - 1);
 
-  memset(lpt_cust, WN, lht_entries);
-  memset(ct_cust, WN, choice_entries);
+  l->index[base] = index_nt;
+  l->index[base + 1] = index_t;
+  l->index[base + 2] = ct_index;
+
+  // SN/WN in the CT choose the not-taken PHT, WT/ST the taken one
+  uint8_t nt = counter_prediction(get_counter(&p->pht_nt, index_nt, cfg->packed));
+  uint8_t t = counter_prediction(get_counter(&p->pht_t, index_t, cfg->packed));
+  l->provider = counter_prediction(get_counter(&p->ct, ct_index, cfg->packed));
+  return l->prediction = l->provider ? t : nt;
+}
+
+static void update_bimode(struct bimode *p, const struct bimode_config *cfg, uint8_t outcome, const struct predictor_token *l, int base)
+{
+  uint32_t index_nt = l->index[base];
+  uint32_t index_t = l->index[base + 1];
+  uint32_t ct_index = l->index[base + 2];
+
+  // Only the PHT chosen by the CT is trained
+  uint8_t ct = get_counter(&p->ct, ct_index, cfg->packed);
+  uint8_t chosen = counter_prediction(ct);
+  struct counter_table *pht = chosen ? &p->pht_t : &p->pht_nt;
+  uint32_t index = chosen ? index_t : index_nt;
+  uint8_t ctr = get_counter(pht, index, cfg->packed);
+  set_counter(pht, index, counter_step(ctr, outcome, ST), cfg->packed);
+
+  // 'wrong' is set when the chosen PHT predicted not taken, the CT
+  // is trained then or when it equals the outcome
+  uint8_t wrong = !counter_prediction(ctr);
+  uint8_t train = wrong | (ct == outcome);
+  set_counter(&p->ct, ct_index, counter_step_if(ct, train, outcome, ST), cfg->packed);
+
+  p->ghistory = ((p->ghistory << 1) | outcome);
+}
 
-  bimode_nt_ghistoryBits = 11;
-  bimode_t_ghistoryBits = 11;
-  ct_PCBits = 11;
+void cleanup_bimode(struct bimode *p)
+{
+  cleanup_counter_table(&p->pht_nt);
+  cleanup_counter_table(&p->pht_t);
+  cleanup_counter_table(&p->ct);
+}
 
-  init_bimode(); // 3 tables, 3 * 2^11 * 2 = 12 * 2^10
-                 // total: (10 + 2 + 8 + 12) * 2^10 = 2^15 = 32Kbits, + max global history register = 11 bits
-                 // budgets: 32Kbits + 11 bits
-  ghistory = 0;
+// cust functions
+void init_cust(struct cust *p, const struct cust_config *cfg)
+{
+  p->cfg = *cfg;
+  int lht_entries = 1 << p->cfg.lIndexBits;                   // 2^10 entries in LHT (Local histort table)
+  int lpt_entries = 1 << p->cfg.lhistoryBits;                 // 2^10 entries in LPT (Local prediction table)
+  int choice_entries = 1 << p->cfg.choiceBits;                // 2^12 entries in CT (Choice prediction table)
+  init_history_table(&p->lht, lht_entries, p->cfg.lhistoryBits, p->cfg.packed); // 2^10 * 10 (bit counter) = 10 * 2^10 bits
+  init_counter_table(&p->lpt, lpt_entries, p->cfg.packed);    // 2^10 * 2 (bit counter) = 2 * 2^10 bits
+  init_counter_table(&p->ct, choice_entries, p->cfg.packed);  // 2^12 * 2 (bit counter) = 8 * 2^10 bits
+
+  fill_counter_table(&p->lpt, lht_entries < lpt_entries ? lht_entries : lpt_entries, WN);
+  fill_counter_table(&p->ct, choice_entries, WN);
+
+  // The bimode half follows the packing of cust
+  p->cfg.bimode.packed = cfg->packed;
+  init_bimode(&p->bimode, &p->cfg.bimode); // 3 tables, 3 * 2^11 * 2 = 12 * 2^10
+                                           // total: (10 + 2 + 8 + 12) * 2^10 = 2^15 = 32Kbits, + max global history register = 11 bits
+                                           // budgets: 32Kbits + 11 bits
+  p->bimode.ghistory = 0;
 }
 
-uint8_t cust_predict(uint32_t pc)
+static uint8_t lookup_cust(struct cust *p, const struct cust_config *cfg, uint32_t pc, struct predictor_token *l)
 {
+  // The bimode half fills l->index[3...] and is kept in l->aux
+  l->aux = lookup_bimode(&p->bimode, &cfg->bimode, pc, l, 3);
+
   // get lower ghistoryBits of pc
-  uint32_t lht_entries = 1 << custLIndexBits;
+  uint32_t lht_entries = 1 << cfg->lIndexBits;
   uint32_t lht_index = pc & (lht_entries - 1);
 
-  uint32_t lpt_entries = 1 << custLhistoryBits;
-  uint32_t lpt_index = lht_cust[lht_index] & (lpt_entries - 1);
+  uint32_t lpt_entries = 1 << cfg->lhistoryBits;
+  uint32_t lpt_index = get_history(&p->lht, lht_index) & (lpt_entries - 1);
+
+  uint32_t ct_entries = 1 << cfg->choiceBits;
+  uint32_t ct_index = p->bimode.ghistory & (ct_entries - 1);
+
+  l->index[0] = lht_index;
+  l->index[1] = lpt_index;
+  l->index[2] = ct_index;
+
+  // SN/WN in the CT choose the local prediction, WT/ST bimode, and the
+  // provider is 0 or 1 + which bimode PHT provided
+  uint8_t local = counter_prediction(get_counter(&p->lpt, lpt_index, cfg->packed));
+  uint8_t chosen = counter_prediction(get_counter(&p->ct, ct_index, cfg->packed));
+  l->provider = chosen ? 1 + l->provider : 0;
+  return l->prediction = chosen ? l->aux : local;
+}
+
+static void update_cust(struct cust *p, const struct cust_config *cfg, uint8_t outcome, const struct predictor_token *l)
+{
+  uint32_t lht_index = l->index[0];
+  uint32_t lpt_index = l->index[1];
+  uint32_t ct_index = l->index[2];
+
+  uint8_t lpt = get_counter(&p->lpt, lpt_index, cfg->packed);
+  uint8_t ct = get_counter(&p->ct, ct_index, cfg->packed);
+  uint8_t lpt_outcome = counter_prediction(lpt);
+  uint8_t bimode_outcome = l->aux;
+
+  // Update state of entry in bht based on outcome
+  lpt = counter_step(lpt, outcome, ST);
+  set_counter(&p->lpt, lpt_index, lpt, cfg->packed);
+
+  update_bimode(&p->bimode, &cfg->bimode, outcome, l, 3);
+  p->bimode.ghistory = (p->bimode.ghistory >> 1);
 
-  uint32_t ct_entries = 1 << custChoiceBits;
-  uint32_t ct_index = ghistory & (ct_entries - 1);
+  // Train the CT when the updated LPT and bimode's prediction disagree
+  uint8_t disagree = counter_prediction(lpt) ^ bimode_outcome;
+  set_counter(&p->ct, ct_index, choice_step(ct, disagree, outcome, lpt_outcome, bimode_outcome), cfg->packed);
 
-  if (ct_cust[ct_index] >= SN && ct_cust[ct_index] <= WN)
+  // Update history register
+  set_history(&p->lht, lht_index, (get_history(&p->lht, lht_index) << 1) | outcome);
+  p->bimode.ghistory = ((p->bimode.ghistory << 1) | outcome);
+}
+
+void cleanup_cust(struct cust *p)
+{
+  cleanup_history_table(&p->lht);
+  cleanup_counter_table(&p->lpt);
+  cleanup_counter_table(&p->ct);
+  cleanup_bimode(&p->bimode);
+}
+
+// perceptron functions
+
+// Weights per row, the history length rounded up to whole vectors
+static inline int perceptron_stride(const struct perceptron_config *cfg)
+{
+  return (cfg->historyBits + PERCEPTRON_LANES - 1) & -PERCEPTRON_LANES;
+}
+
+void init_perceptron(struct perceptron *p, const struct perceptron_config *cfg)
+{
+  p->cfg = *cfg;
+  int entries = 1 << p->cfg.indexBits;                        // 2^7 perceptrons
+  int stride = perceptron_stride(&p->cfg);                    // 2^7 * (31 + 1 bias) * 8 bits = 32Kbits, + 31 bits of history
+  p->theta = (int)(1.93 * p->cfg.historyBits + 14);           // Threshold from the perceptron paper
+  p->bias = (int8_t *)calloc(entries, sizeof(int8_t));
+  p->weights = (int8_t *)calloc((size_t)entries * stride, sizeof(int8_t));
+
+  memset(p->live, 0, sizeof(p->live));
+  memset(p->live, -1, p->cfg.historyBits);
+
+  // Start from an all not-taken history, like the other predictors
+  p->pos = 0;
+  memset(p->history, -1, sizeof(p->history));
+  p->ghistory = 0;
+}
+
+static uint8_t lookup_perceptron(struct perceptron *p, const struct perceptron_config *cfg, uint32_t pc, struct predictor_token *l)
+{
+  int stride = perceptron_stride(cfg);
+  uint32_t row = pc;
+  if (cfg->hashed)
+  {
+    row ^= p->ghistory;
+  }
+  row &= (1 << cfg->indexBits) - 1;
+  int y = p->bias[row] + perceptron_dot(p->weights + row * stride, p->history + p->pos, stride);
+
+  // The output is needed for training, it goes in index[1]
+  l->index[0] = row;
+  l->index[1] = (uint32_t)y;
+  l->provider = 0;
+  return l->prediction = y >= 0 ? TAKEN : NOTTAKEN;
+}
+
+static void update_perceptron(struct perceptron *p, const struct perceptron_config *cfg, uint8_t outcome, const struct predictor_token *l)
+{
+  int stride = perceptron_stride(cfg);
+  uint32_t row = l->index[0];
+  int y = (int32_t)l->index[1];
+  int t = outcome ? 1 : -1;
+
+  // Train on a misprediction or while the output is not confident
+  if (l->prediction != outcome || abs(y) <= p->theta)
   {
-    switch (lpt_cust[lpt_index])
+    int bias = p->bias[row] + t;
+    if (bias >= -PERCEPTRON_WEIGHT_MAX && bias <= PERCEPTRON_WEIGHT_MAX)
     {
-    case WN:
-      return NOTTAKEN;
-    case SN:
-      return NOTTAKEN;
-    case WT:
-      return TAKEN;
-    case ST:
-      return TAKEN;
-    default:
-      printf("Warning: Undefined state of entry in cust LPT!\n");
-      return NOTTAKEN;
+      p->bias[row] = bias;
     }
+    perceptron_train(p->weights + row * stride, p->history + p->pos, p->live, stride, t);
   }
-  else if (ct_cust[ct_index] >= WT && ct_cust[ct_index] <= ST)
+
+  // Update history register
+  p->pos = (p->pos - 1) & (PERCEPTRON_MAX_HISTORY - 1);
+  p->history[p->pos] = t;
+  p->history[p->pos + PERCEPTRON_MAX_HISTORY] = t;
+  p->ghistory = (p->ghistory << 1) | outcome;
+}
+
+void cleanup_perceptron(struct perceptron *p)
+{
+  free(p->bias);
+  free(p->weights);
+}
+
+// The per-type loop of predictor_predict_batch. LOOKUP and UPDATE see
+// the branch as 'pc' and 'outcome' and its token as 'l', and are direct
+// calls the compiler can inline and keep the tables and history in
+// registers across. RECORD runs after each prediction.
+#define BATCH_LOOP(LOOKUP, UPDATE, RECORD)                             \
+  for (size_t i = 0; i < n; i++)                                       \
+  {                                                                    \
+    struct predictor_token token, *l = &token;                         \
+    uint32_t pc = pcs[i];                                              \
+    uint8_t outcome = outcomes[i];                                     \
+    uint8_t prediction = LOOKUP;                                       \
+    UPDATE;                                                            \
+    RECORD;                                                            \
+    wrong += prediction != outcome;                                    \
+    if (bitmap)                                                        \
+    {                                                                  \
+      bitmap[i >> 6] |= (uint64_t)prediction << (i & 63);              \
+    }                                                                  \
+  }
+
+// The loop is written out twice so that plain runs do not pay for the
+// profile. Counting in the same loop lets the profile's table updates
+// overlap with the predictor's own work.
+#define BATCH_LOOPS(LOOKUP, UPDATE)                                            \
+  if (prof)                                                                    \
+  {                                                                            \
+    BATCH_LOOP(LOOKUP, UPDATE, profile_count(prof, pc, outcome, prediction, l->provider)); \
+  }                                                                            \
+  else                                                                         \
+  {                                                                            \
+    BATCH_LOOP(LOOKUP, UPDATE, (void)0);                                       \
+  }
+
+// A batch loop over the functions of 'TYPE' with 'CFG' as the config
+#define DEFINE_KERNEL(NAME, MEMBER, TYPE, CFG)                                                \
+  static uint32_t NAME(struct predictor *p, const uint32_t *pcs, const uint8_t *outcomes,     \
+                       size_t n, uint64_t *bitmap, struct profile *prof)                      \
+  {                                                                                           \
+    const struct MEMBER##_config *cfg = CFG;                                                  \
+    uint32_t wrong = 0;                                                                       \
+    BATCH_LOOPS(TYPE##_lookup_with(p, cfg, pc, l), TYPE##_update_with(p, cfg, outcome, l));   \
+    return wrong;                                                                             \
+  }
+
+//------------------------------------//
+//        Registry Entry Points       //
+//------------------------------------//
+//
+// Each type's lookup and update are written once as LOOKUP/UPDATE over
+// its own state in p->MEMBER and a config pointer 'cfg'. The entry
+// points of the registry pass the instance's config, the batch kernels
+// are built from the same expressions.
+
+#define DEFINE_ENTRY_POINTS(TYPE, MEMBER, LOOKUP, UPDATE)                                      \
+  static inline uint8_t TYPE##_lookup_with(struct predictor *p, const struct MEMBER##_config *cfg, \
+                                           uint32_t pc, struct predictor_token *l)             \
+  {                                                                                            \
+    return LOOKUP;                                                                             \
+  }                                                                                            \
+  static inline void TYPE##_update_with(struct predictor *p, const struct MEMBER##_config *cfg, \
+                                        uint8_t outcome, const struct predictor_token *l)      \
+  {                                                                                            \
+    UPDATE;                                                                                    \
+  }                                                                                            \
+  static void TYPE##_init(struct predictor *p, const struct predictor_config *cfg)             \
+  {                                                                                            \
+    init_##MEMBER(&p->MEMBER, &cfg->MEMBER);                                                   \
+  }                                                                                            \
+  static uint8_t TYPE##_lookup(struct predictor *p, uint32_t pc, struct predictor_token *l)    \
+  {                                                                                            \
+    return TYPE##_lookup_with(p, &p->MEMBER.cfg, pc, l);                                       \
+  }                                                                                            \
+  static void TYPE##_update(struct predictor *p, uint8_t outcome, const struct predictor_token *l) \
+  {                                                                                            \
+    TYPE##_update_with(p, &p->MEMBER.cfg, outcome, l);                                         \
+  }                                                                                            \
+  static void TYPE##_cleanup(struct predictor *p)                                              \
+  {                                                                                            \
+    cleanup_##MEMBER(&p->MEMBER);                                                              \
+  }                                                                                            \
+  DEFINE_KERNEL(TYPE##_batch, MEMBER, TYPE, &p->MEMBER.cfg)
+
+DEFINE_ENTRY_POINTS(type_gshare, gshare,
+                    lookup_gshare(&p->gshare, cfg, pc, l),
+                    update_gshare(&p->gshare, cfg, outcome, l))
+DEFINE_ENTRY_POINTS(type_tournament, alpha21264,
+                    lookup_alpha21264(&p->alpha21264, cfg, pc, l),
+                    update_alpha21264(&p->alpha21264, cfg, outcome, l))
+DEFINE_ENTRY_POINTS(type_custom, cust,
+                    lookup_cust(&p->cust, cfg, pc, l),
+                    update_cust(&p->cust, cfg, outcome, l))
+DEFINE_ENTRY_POINTS(type_tage, tage,
+                    lookup_tage(&p->tage, cfg, pc, l),
+                    update_tage(&p->tage, cfg, outcome, l))
+DEFINE_ENTRY_POINTS(type_bimode, bimode,
+                    lookup_bimode(&p->bimode, cfg, pc, l, 0),
+                    update_bimode(&p->bimode, cfg, outcome, l, 0))
+DEFINE_ENTRY_POINTS(type_perceptron, perceptron,
+                    lookup_perceptron(&p->perceptron, cfg, pc, l),
+                    update_perceptron(&p->perceptron, cfg, outcome, l))
+
+// Static has no state, it always predicts taken
+static uint8_t type_static_lookup(struct predictor *p, uint32_t pc, struct predictor_token *l)
+{
+  l->provider = 0;
+  return l->prediction = TAKEN;
+}
+
+static void type_static_update(struct predictor *p, uint8_t outcome, const struct predictor_token *l)
+{
+}
+
+static uint32_t type_static_batch(struct predictor *p, const uint32_t *pcs, const uint8_t *outcomes,
+                                  size_t n, uint64_t *bitmap, struct profile *prof)
+{
+  uint32_t wrong = 0;
+  BATCH_LOOPS(type_static_lookup(p, pc, l), (void)l);
+  return wrong;
+}
+
+//------------------------------------//
+//        Specialized Kernels         //
+//------------------------------------//
+//
+// The lookup and update functions take their geometry from a config
+// pointer. A specialized kernel hands them a static const config, so
+// once they are inlined every table size, mask and history length is a
+// constant and the TAGE component loops unroll. predictor_create picks
+// the kernel whose config equals the instance's, anything else runs
+// the type's generic kernel. Setting BP_NO_SPECIALIZE in the
+// environment forces the generic kernels.
+//
+// The configs are listed in the field order of struct <member>_config.
+
+#define DEFINE_SPECIALIZED_KERNEL(NAME, TYPE, MEMBER, ...)              \
+  static const struct MEMBER##_config NAME##_config = {__VA_ARGS__};  \
+  DEFINE_KERNEL(NAME, MEMBER, TYPE, &NAME##_config)
+
+// The default configurations, as used by the handin and the results
+DEFINE_SPECIALIZED_KERNEL(gshare_14, type_gshare, gshare, 14, 0)
+DEFINE_SPECIALIZED_KERNEL(tournament_12_11_10_12, type_tournament, alpha21264, 12, 11, 10, 12, 0)
+DEFINE_SPECIALIZED_KERNEL(custom_10_10_12, type_custom, cust, 10, 10, 12, 0, {11, 11, 11, 0})
+DEFINE_SPECIALIZED_KERNEL(tage_10_8_11, type_tage, tage, 10, 8, 11, {5, 9, 15, 25, 44, 76, 130}, 1, 5, 5)
+DEFINE_SPECIALIZED_KERNEL(bimode_11_11_11, type_bimode, bimode, 11, 11, 11, 0)
+DEFINE_SPECIALIZED_KERNEL(perceptron_31_7, type_perceptron, perceptron, 31, 7, 0)
+
+struct specialized_kernel
+{
+  size_t offset;     // Offset of the instance's config in struct predictor
+  const void *cfg;   // Config the kernel was built for
+  size_t size;
+  batch_kernel fn;
+};
+
+#define KERNEL(MEMBER, NAME) \
+  {offsetof(struct predictor, MEMBER.cfg), &NAME##_config, sizeof(NAME##_config), NAME}
+
+// The kernels of each type, registered with it
+static const struct specialized_kernel gshare_kernels[] = {KERNEL(gshare, gshare_14)};
+static const struct specialized_kernel tournament_kernels[] = {KERNEL(alpha21264, tournament_12_11_10_12)};
+static const struct specialized_kernel custom_kernels[] = {KERNEL(cust, custom_10_10_12)};
+static const struct specialized_kernel tage_kernels[] = {KERNEL(tage, tage_10_8_11)};
+static const struct specialized_kernel bimode_kernels[] = {KERNEL(bimode, bimode_11_11_11)};
+static const struct specialized_kernel perceptron_kernels[] = {KERNEL(perceptron, perceptron_31_7)};
+
+// Returns the specialized kernel for the configuration of 'p', or NULL
+// if there is none
+static batch_kernel find_kernel(const struct predictor *p)
+{
+  if (getenv("BP_NO_SPECIALIZE"))
   {
-    return bimode_predict(pc);
+    return NULL;
   }
-  else
+  for (int i = 0; i < p->ops->num_kernels; i++)
   {
-    printf("Warning: Undefined state of entry in cust CT!\n");
-    return NOTTAKEN;
+    const struct specialized_kernel *k = &p->ops->kernels[i];
+    if (memcmp((const char *)p + k->offset, k->cfg, k->size) == 0)
+    {
+      return k->fn;
+    }
   }
+  return NULL;
 }
 
-void train_cust(uint32_t pc, uint8_t outcome)
+//------------------------------------//
+//        Predictor Registry          //
+//------------------------------------//
+
+#define PARAM(name, field, min, max) \
+  {name, offsetof(struct predictor_config, field), min, max}
+
+// Parameter schemas, in the positional order of "<type>:<value>:..."
+static const struct predictor_param gshare_params[] = {
+    PARAM("ghistoryBits", gshare.ghistoryBits, 1, 24),
+    PARAM("packed", gshare.packed, 0, 1),
+};
+
+static const struct predictor_param tournament_params[] = {
+    PARAM("ghistoryBits", alpha21264.ghistoryBits, 1, 24),
+    PARAM("lhistoryBits", alpha21264.lhistoryBits, 1, 24),
+    PARAM("lIndexBits", alpha21264.lIndexBits, 1, 24),
+    PARAM("choiceBits", alpha21264.choiceBits, 1, 24),
+    PARAM("packed", alpha21264.packed, 0, 1),
+};
+
+static const struct predictor_param custom_params[] = {
+    PARAM("lhistoryBits", cust.lhistoryBits, 1, 24),
+    PARAM("lIndexBits", cust.lIndexBits, 1, 24),
+    PARAM("choiceBits", cust.choiceBits, 1, 24),
+    PARAM("nt_ghistoryBits", cust.bimode.nt_ghistoryBits, 1, 24),
+    PARAM("t_ghistoryBits", cust.bimode.t_ghistoryBits, 1, 24),
+    PARAM("ct_PCBits", cust.bimode.ct_PCBits, 1, 24),
+    PARAM("packed", cust.packed, 0, 1),
+};
+
+static const struct predictor_param tage_params[] = {
+    PARAM("T0_PC", tage.T0_PC, 1, 24),
+    PARAM("Ti_PC", tage.Ti_PC, 1, 24),
+    PARAM("tag_bit", tage.tag_bit, 1, 16 - TAGE_TAG_SHIFT),
+    PARAM("L1", tage.used_length[0], 1, HISTORY_MAX_LENGTH - 1),
+    PARAM("L2", tage.used_length[1], 1, HISTORY_MAX_LENGTH - 1),
+    PARAM("L3", tage.used_length[2], 1, HISTORY_MAX_LENGTH - 1),
+    PARAM("L4", tage.used_length[3], 1, HISTORY_MAX_LENGTH - 1),
+    PARAM("L5", tage.used_length[4], 1, HISTORY_MAX_LENGTH - 1),
+    PARAM("L6", tage.used_length[5], 1, HISTORY_MAX_LENGTH - 1),
+    PARAM("L7", tage.used_length[6], 1, HISTORY_MAX_LENGTH - 1),
+    PARAM("altpred", tage.altpred, 0, 1),
+    PARAM("loopBits", tage.loopBits, 0, 16),
+    PARAM("scBits", tage.scBits, 0, 16),
+};
+
+static const struct predictor_param bimode_params[] = {
+    PARAM("nt_ghistoryBits", bimode.nt_ghistoryBits, 1, 24),
+    PARAM("t_ghistoryBits", bimode.t_ghistoryBits, 1, 24),
+    PARAM("ct_PCBits", bimode.ct_PCBits, 1, 24),
+    PARAM("packed", bimode.packed, 0, 1),
+};
+
+static const struct predictor_param perceptron_params[] = {
+    PARAM("historyBits", perceptron.historyBits, 1, PERCEPTRON_MAX_HISTORY),
+    PARAM("indexBits", perceptron.indexBits, 1, 24),
+    PARAM("hashed", perceptron.hashed, 0, 1),
+};
+
+static long max_long(long a, long b)
 {
-  // get lower ghistoryBits of pc
-  uint32_t lht_entries = 1 << custLIndexBits;
-  uint32_t lht_index = pc & (lht_entries - 1);
+  return a > b ? a : b;
+}
 
-  uint32_t lpt_entries = 1 << custLhistoryBits;
-  uint32_t lpt_index = lht_cust[lht_index] & (lpt_entries - 1);
+// Storage costs, in bits of tables and history registers
 
-  uint32_t ct_entries = 1 << custChoiceBits;
-  uint32_t ct_index = ghistory & (ct_entries - 1);
+static long type_static_storage(const struct predictor_config *cfg)
+{
+  return 0;
+}
 
-  uint8_t lpt_outcome;
-  uint8_t bimode_outcome = bimode_predict(pc);
+static long type_gshare_storage(const struct predictor_config *cfg)
+{
+  // 2-bit BHT + global history
+  return (2L << cfg->gshare.ghistoryBits) + cfg->gshare.ghistoryBits;
+}
 
-  // Update state of entry in bht based on outcome
-  switch (lpt_cust[lpt_index])
-  {
-  case WN:
-    lpt_cust[lpt_index] = (outcome == TAKEN) ? WT : SN;
-    lpt_outcome = NOTTAKEN;
-    break;
-  case SN:
-    lpt_cust[lpt_index] = (outcome == TAKEN) ? WN : SN;
-    lpt_outcome = NOTTAKEN;
-    break;
-  case WT:
-    lpt_cust[lpt_index] = (outcome == TAKEN) ? ST : WN;
-    lpt_outcome = TAKEN;
-    break;
-  case ST:
-    lpt_cust[lpt_index] = (outcome == TAKEN) ? ST : WT;
-    lpt_outcome = TAKEN;
-    break;
-  default:
-    printf("Warning: Undefined state of entry in GSHARE BHT!\n");
-  }
-
-  train_bimode(pc, outcome);
-  ghistory = (ghistory >> 1);
-
-  if ((lpt_cust[lpt_index] == ST || lpt_cust[lpt_index] == WT) ^ (bimode_outcome == TAKEN))
-  {
-    switch (ct_cust[ct_index])
+static long type_tournament_storage(const struct predictor_config *cfg)
+{
+  const struct alpha21264_config *a = &cfg->alpha21264;
+
+  // LHT of local histories, 2-bit LPT, GPT and CT + global history
+  return (a->lhistoryBits * (1L << a->lIndexBits)) + (2L << a->lhistoryBits) +
+         (2L << a->ghistoryBits) + (2L << a->choiceBits) +
+         max_long(a->ghistoryBits, a->choiceBits);
+}
+
+static long bimode_history(const struct bimode_config *b)
+{
+  return max_long(max_long(b->nt_ghistoryBits, b->t_ghistoryBits), b->ct_PCBits);
+}
+
+static long bimode_tables(const struct bimode_config *b)
+{
+  return (2L << b->nt_ghistoryBits) + (2L << b->t_ghistoryBits) + (2L << b->ct_PCBits);
+}
+
+static long type_bimode_storage(const struct predictor_config *cfg)
+{
+  // Three 2-bit tables + global history
+  return bimode_tables(&cfg->bimode) + bimode_history(&cfg->bimode);
+}
+
+static long type_custom_storage(const struct predictor_config *cfg)
+{
+  const struct cust_config *c = &cfg->cust;
+
+  // Bimode, plus the LHT of local histories, 2-bit LPT and CT
+  return bimode_tables(&c->bimode) + (c->lhistoryBits * (1L << c->lIndexBits)) +
+         (2L << c->lhistoryBits) + (2L << c->choiceBits) +
+         max_long(bimode_history(&c->bimode), c->choiceBits);
+}
+
+static long type_tage_storage(const struct predictor_config *cfg)
+{
+  const struct tage_config *t = &cfg->tage;
+  long history = 0;
+
+  // 2-bit base predictor, tagged entries of 3-bit ctr + 2-bit u + tag,
+  // the longest history and the folded history registers
+  long bits = (2L << t->T0_PC) + TAGE_COMPONENTS * (1L << t->Ti_PC) * (3 + 2 + t->tag_bit);
+  for (int i = 0; i < TAGE_COMPONENTS; i++)
+  {
+    history = max_long(history, t->used_length[i] + 1);
+  }
+  bits += history + TAGE_COMPONENTS * (t->Ti_PC + 2 * t->tag_bit);
+  if (t->altpred)
+  {
+    // use_alt_on_na
+    bits += 4;
+  }
+  if (t->loopBits)
+  {
+    // Loop entries + the 7-bit counter choosing the loop predictor
+    bits += (1L << t->loopBits) * TAGE_LOOP_ENTRY_BITS + 7;
+  }
+  if (t->scBits)
+  {
+    // SC tables, their folded histories, threshold and its counter
+    // (their histories are shorter than the TAGE ones)
+    bits += TAGE_SC_TABLES * (1L << t->scBits) * TAGE_SC_CTR_BITS + (TAGE_SC_TABLES - 1) * t->scBits + 8 + 7;
+  }
+  return bits;
+}
+
+static long type_perceptron_storage(const struct predictor_config *cfg)
+{
+  // 8-bit weights and bias per perceptron + global history, which
+  // must also cover the index when it is hashed
+  const struct perceptron_config *c = &cfg->perceptron;
+  return (1L << c->indexBits) * (c->historyBits + 1) * 8 +
+         (c->hashed ? max_long(c->historyBits, c->indexBits) : c->historyBits);
+}
+
+// The descriptor of a type whose functions are TYPE_<entry point>, the
+// providers are listed by provider + 1
+#define REGISTER(NAME, TYPE, PARAMS, KERNELS, ...)                            \
+  {NAME, PARAMS, sizeof(PARAMS) / sizeof(PARAMS[0]), TYPE##_storage,          \
+   TYPE##_init, TYPE##_lookup, TYPE##_update, TYPE##_cleanup, TYPE##_batch,   \
+   KERNELS, sizeof(KERNELS) / sizeof(KERNELS[0]), {__VA_ARGS__}}
+
+const struct predictor_type predictor_types[] = {
+    [STATIC] = {"Static", NULL, 0, type_static_storage,
+                NULL, type_static_lookup, type_static_update, NULL, type_static_batch,
+                NULL, 0, {NULL, "static"}},
+    [GSHARE] = REGISTER("Gshare", type_gshare, gshare_params, gshare_kernels,
+                        NULL, "gshare"),
+    [TOURNAMENT] = REGISTER("Tournament", type_tournament, tournament_params, tournament_kernels,
+                            NULL, "local", "global"),
+    [CUSTOM] = REGISTER("Custom", type_custom, custom_params, custom_kernels,
+                        NULL, "local", "bimode_nt", "bimode_t"),
+    [TAGE] = REGISTER("TAGE", type_tage, tage_params, tage_kernels,
+                      "base", "t0", "t1", "t2", "t3", "t4", "t5", "t6"),
+    [BIMODE] = REGISTER("Bimode", type_bimode, bimode_params, bimode_kernels,
+                        NULL, "nt_pht", "t_pht"),
+    [PERCEPTRON] = REGISTER("Perceptron", type_perceptron, perceptron_params, perceptron_kernels,
+                            NULL, "perceptron"),
+};
+
+_Static_assert(sizeof(predictor_types) / sizeof(predictor_types[0]) == BP_TYPES,
+               "every predictor type needs a descriptor");
+
+int predictor_type_find(const char *name, size_t len)
+{
+  for (int i = 0; i < BP_TYPES; i++)
+  {
+    if (strlen(predictor_types[i].name) == len && !strncasecmp(name, predictor_types[i].name, len))
     {
-    case WN:
-      ct_cust[ct_index] = (outcome == lpt_outcome) ? SN : WT;
-      break;
-    case SN:
-      ct_cust[ct_index] = (outcome == lpt_outcome) ? SN : WN;
-      break;
-    case WT:
-      ct_cust[ct_index] = (outcome == bimode_outcome) ? ST : WN;
-      break;
-    case ST:
-      ct_cust[ct_index] = (outcome == bimode_outcome) ? ST : WT;
-      break;
-    default:
-      printf("Warning: Undefined state of entry in GSHARE BHT!\n");
+      return i;
     }
   }
+  return -1;
+}
 
-  // Update history register
-  lht_cust[lht_index] = ((lht_cust[lht_index] << 1) | outcome);
-  ghistory = ((ghistory << 1) | outcome);
+const struct predictor_param *predictor_param_find(int type, const char *name, size_t len)
+{
+  const struct predictor_type *t = &predictor_types[type];
+  for (int i = 0; i < t->num_params; i++)
+  {
+    const struct predictor_param *param = &t->params[i];
+    if (strlen(param->name) == len && !strncasecmp(param->name, name, len))
+    {
+      return param;
+    }
+  }
+  return NULL;
 }
 
-void cleanup_cust()
+int *predictor_param_ref(struct predictor_config *cfg, const struct predictor_param *param)
 {
-  free(lht_cust);
-  free(lpt_cust);
-  free(gpt_cust);
-  free(ct_cust);
-  cleanup_bimode();
+  return (int *)((char *)cfg + param->offset);
 }
 
-void init_predictor()
+long predictor_storage_bits(const struct predictor_config *cfg)
+{
+  if (cfg->type < 0 || cfg->type >= BP_TYPES)
+  {
+    return -1;
+  }
+  return predictor_types[cfg->type].storage_bits(cfg);
+}
+
+//------------------------------------//
+//       Instance Predictor API       //
+//------------------------------------//
+
+void predictor_config_init(struct predictor_config *cfg, int type)
+{
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->type = type;
+
+  cfg->gshare.ghistoryBits = ghistoryBits;
+  cfg->gshare.packed = packedTables;
+
+  cfg->alpha21264.ghistoryBits = alpha21264GhistoryBits;
+  cfg->alpha21264.lhistoryBits = alpha21264LhistoryBits;
+  cfg->alpha21264.lIndexBits = alpha21264LIndexBits;
+  cfg->alpha21264.choiceBits = alpha21264ChoiceBits;
+  cfg->alpha21264.packed = packedTables;
+
+  cfg->tage.T0_PC = T0_PC;
+  cfg->tage.Ti_PC = Ti_PC;
+  cfg->tage.tag_bit = tag_bit;
+  for (int i = 0; i < TAGE_COMPONENTS; i++)
+  {
+    cfg->tage.used_length[i] = tage_component_used_length[i];
+  }
+  cfg->tage.altpred = tage_altpred;
+  cfg->tage.loopBits = tage_loopBits;
+  cfg->tage.scBits = tage_scBits;
+
+  cfg->bimode.nt_ghistoryBits = bimode_nt_ghistoryBits;
+  cfg->bimode.t_ghistoryBits = bimode_t_ghistoryBits;
+  cfg->bimode.ct_PCBits = ct_PCBits;
+  cfg->bimode.packed = packedTables;
+
+  cfg->cust.lhistoryBits = custLhistoryBits;
+  cfg->cust.lIndexBits = custLIndexBits;
+  cfg->cust.choiceBits = custChoiceBits;
+  cfg->cust.packed = packedTables;
+  cfg->cust.bimode = cfg->bimode;
+
+  cfg->perceptron.historyBits = perceptronHistoryBits;
+  cfg->perceptron.indexBits = perceptronIndexBits;
+  cfg->perceptron.hashed = perceptronHashed;
+}
+
+struct predictor *predictor_create(const struct predictor_config *cfg)
+{
+  if (cfg->type < 0 || cfg->type >= BP_TYPES)
+  {
+    return NULL;
+  }
+
+  struct predictor *p = (struct predictor *)calloc(1, sizeof(struct predictor));
+  p->type = cfg->type;
+  p->ops = &predictor_types[p->type];
+  if (p->ops->init)
+  {
+    p->ops->init(p, cfg);
+  }
+  p->kernel = find_kernel(p);
+  if (!p->kernel)
+  {
+    p->kernel = p->ops->batch;
+  }
+  return p;
+}
+
+uint8_t predictor_lookup(struct predictor *p, uint32_t pc, struct predictor_token *l)
+{
+  return p->ops->lookup(p, pc, l);
+}
+
+void predictor_update(struct predictor *p, uint32_t pc, uint8_t outcome, const struct predictor_token *l)
+{
+  p->ops->update(p, outcome, l);
+}
+
+uint8_t predictor_predict_and_update(struct predictor *p, uint32_t pc, uint8_t outcome)
+{
+  struct predictor_token l;
+  uint8_t prediction = predictor_lookup(p, pc, &l);
+  predictor_update(p, pc, outcome, &l);
+  return prediction;
+}
+
+uint8_t predictor_predict(struct predictor *p, uint32_t pc)
+{
+  struct predictor_token l;
+  return predictor_lookup(p, pc, &l);
+}
+
+void predictor_train(struct predictor *p, uint32_t pc, uint8_t outcome)
+{
+  predictor_predict_and_update(p, pc, outcome);
+}
+
+uint32_t predictor_predict_batch(struct predictor *p, const uint32_t *pcs, const uint8_t *outcomes,
+                                 size_t n, uint64_t *bitmap)
 {
-  switch (bpType)
+  return predictor_profile_batch(p, pcs, outcomes, n, bitmap, NULL);
+}
+
+uint32_t predictor_profile_batch(struct predictor *p, const uint32_t *pcs, const uint8_t *outcomes,
+                                 size_t n, uint64_t *bitmap, struct profile *prof)
+{
+  if (bitmap)
   {
-  case STATIC:
-  case GSHARE:
-    init_gshare();
-    break;
-  case TOURNAMENT:
-    init_alpha21264();
-    break;
-  case CUSTOM:
-    // init_tage();
-    // init_bimode();
-    init_cust();
-  default:
-    break;
+    memset(bitmap, 0, (n + 63) / 64 * sizeof(uint64_t));
   }
+  return p->kernel(p, pcs, outcomes, n, bitmap, prof);
+}
+
+void predictor_destroy(struct predictor *p)
+{
+  if (!p)
+  {
+    return;
+  }
+  if (p->ops->cleanup)
+  {
+    p->ops->cleanup(p);
+  }
+  free(p);
+}
+
+//------------------------------------//
+//     Single Predictor Wrappers      //
+//------------------------------------//
+
+// The instance behind init_predictor/make_prediction/train_predictor
+static struct predictor *default_predictor;
+
+void init_predictor()
+{
+  struct predictor_config cfg;
+  predictor_config_init(&cfg, bpType);
+
+  predictor_destroy(default_predictor);
+  default_predictor = predictor_create(&cfg);
 }
 
 // Make a prediction for conditional branch instruction at PC 'pc'
@@ -952,26 +1820,8 @@ void init_predictor()
 //
 uint8_t make_prediction(uint32_t pc)
 {
-
   // Make a prediction based on the bpType
-  switch (bpType)
-  {
-  case STATIC:
-    return TAKEN;
-  case GSHARE:
-    return gshare_predict(pc);
-  case TOURNAMENT:
-    return alpha21264_predict(pc);
-  case CUSTOM:
-    // return tage_predict(pc);
-    // return bimode_predict(pc);
-    return cust_predict(pc);
-  default:
-    break;
-  }
-
-  // If there is not a compatable bpType then return NOTTAKEN
-  return NOTTAKEN;
+  return predictor_predict(default_predictor, pc);
 }
 
 // Train the predictor the last executed branch at PC 'pc' and with
@@ -981,19 +1831,13 @@ uint8_t make_prediction(uint32_t pc)
 
 void train_predictor(uint32_t pc, uint8_t outcome)
 {
+  predictor_train(default_predictor, pc, outcome);
+}
 
-  switch (bpType)
-  {
-  case STATIC:
-  case GSHARE:
-    return train_gshare(pc, outcome);
-  case TOURNAMENT:
-    return train_alpha21264(pc, outcome);
-  case CUSTOM:
-    // return train_tage(pc, outcome);
-    // return train_bimode(pc, outcome);
-    train_cust(pc, outcome);
-  default:
-    break;
-  }
+// Predict the branch at PC 'pc' and train on its outcome in one go,
+// returning the prediction made before training
+//
+uint8_t predict_and_update(uint32_t pc, uint8_t outcome)
+{
+  return predictor_predict_and_update(default_predictor, pc, outcome);
 }
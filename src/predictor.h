@@ -25,12 +25,19 @@ extern const char *email;
 #define NOTTAKEN  0
 #define TAKEN     1
 
-// The Different Predictor Types
-#define STATIC      0
-#define GSHARE      1
-#define TOURNAMENT  2
-#define CUSTOM      3
-extern const char *bpName[];
+// The Different Predictor Types. Each one has a descriptor in
+// predictor_types, BP_TYPES is their number.
+enum
+{
+  STATIC,
+  GSHARE,
+  TOURNAMENT,
+  CUSTOM,
+  TAGE,
+  BIMODE,
+  PERCEPTRON,
+  BP_TYPES
+};
 
 // Definitions for 2-bit counters
 #define SN  0			// predict NT, strong not taken
@@ -67,4 +74,242 @@ uint8_t make_prediction(uint32_t pc);
 //
 void train_predictor(uint32_t pc, uint8_t outcome);
 
+// Make a prediction for the branch at PC 'pc' and train the predictor
+// with its outcome, looking the tables up only once. Returns the
+// prediction made before training.
+//
+uint8_t predict_and_update(uint32_t pc, uint8_t outcome);
+
+//------------------------------------//
+//      Instance Predictor API        //
+//------------------------------------//
+//
+// Every predictor created below owns all of its state, so any number of
+// them can live in one process and separate instances can be used from
+// separate threads. init_predictor, make_prediction and train_predictor
+// drive a single instance built from bpType and the globals above.
+//
+
+#define TAGE_COMPONENTS 7
+#define TAGE_SC_TABLES  4   // Bias table + 3 global history tables
+
+// With 'packed' set the 2-bit counter tables hold four counters per
+// byte and local history tables hold each history in exactly its
+// width, so the host memory matches the hardware budget. Predictions
+// are the same either way.
+
+struct gshare_config
+{
+  int ghistoryBits;  // Number of bits used for Global History
+  int packed;        // Bit-packed tables
+};
+
+struct alpha21264_config
+{
+  int ghistoryBits;  // Number of Path history bits used for Global prediction
+  int lhistoryBits;  // Number of bits of local history indexing the LPT
+  int lIndexBits;    // Number of Program counter bits used for Local history table
+  int choiceBits;    // Number of Path history bits used for Choice prediction
+  int packed;        // Bit-packed tables
+};
+
+struct tage_config
+{
+  int T0_PC;         // log2 of the base predictor entries
+  int Ti_PC;         // log2 of the entries of each tagged component
+  int tag_bit;       // Tag width of the tagged components
+  int used_length[TAGE_COMPONENTS]; // Global history length per component
+  int altpred;       // Full TAGE update with the alternate prediction and
+                     // use_alt_on_na, 0 keeps the original update
+  int loopBits;      // log2 of the loop predictor entries, 0 disables it
+  int scBits;        // log2 of the entries of each statistical corrector
+                     // table, 0 disables it
+};
+
+struct bimode_config
+{
+  int nt_ghistoryBits; // log2 of the not-taken PHT entries
+  int t_ghistoryBits;  // log2 of the taken PHT entries
+  int ct_PCBits;       // log2 of the choice table entries
+  int packed;          // Bit-packed tables
+};
+
+struct perceptron_config
+{
+  int historyBits;   // Global history length weighed by each perceptron
+  int indexBits;     // log2 of the number of perceptrons, indexed by PC
+  int hashed;        // Index by PC xor global history, as gshare does
+};
+
+struct cust_config
+{
+  int lhistoryBits;  // Number of bits of local history indexing the LPT
+  int lIndexBits;    // Number of Program counter bits used for Local history table
+  int choiceBits;    // Number of Path history bits used for Choice prediction
+  int packed;        // Bit-packed tables, for the bimode half as well
+  struct bimode_config bimode;
+};
+
+struct predictor_config
+{
+  int type;          // One of the predictor types above
+  struct gshare_config gshare;
+  struct alpha21264_config alpha21264;
+  struct tage_config tage;
+  struct bimode_config bimode;
+  struct cust_config cust;
+  struct perceptron_config perceptron;
+};
+
+// A tunable int of struct predictor_config, used to parse and sweep
+// configurations by name
+struct predictor_param
+{
+  const char *name;  // Name of the matching global default
+  size_t offset;     // Byte offset in struct predictor_config
+  int min;           // Smallest and largest value accepted
+  int max;
+};
+
+// Returns the type named by the first 'len' bytes of 'name'
+// (case-insensitive), or -1 if there is none
+//
+int predictor_type_find(const char *name, size_t len);
+
+// Returns the parameter of 'type' named by the first 'len' bytes of
+// 'name' (case-insensitive), or NULL if there is none
+//
+const struct predictor_param *predictor_param_find(int type, const char *name, size_t len);
+
+// Returns the field of 'cfg' that 'param' describes
+//
+int *predictor_param_ref(struct predictor_config *cfg, const struct predictor_param *param);
+
+// Returns the hardware budget of the tables and history registers of
+// 'cfg' in bits, or -1 if the type is unknown
+//
+long predictor_storage_bits(const struct predictor_config *cfg);
+
+// The contest budget, 32Kbits of tables plus 320 bits of registers
+#define PREDICTOR_BUDGET_BITS (32768 + 320)
+
+struct predictor;
+struct profile;
+
+// Fill 'cfg' with the default configuration for 'type'
+//
+void predictor_config_init(struct predictor_config *cfg, int type);
+
+// Returns a new predictor, or NULL if the type is unknown
+//
+struct predictor *predictor_create(const struct predictor_config *cfg);
+
+uint8_t predictor_predict(struct predictor *p, uint32_t pc);
+
+void predictor_train(struct predictor *p, uint32_t pc, uint8_t outcome);
+
+// Equivalent to predictor_predict followed by predictor_train, but the
+// table indices and entries are computed once
+//
+uint8_t predictor_predict_and_update(struct predictor *p, uint32_t pc, uint8_t outcome);
+
+// Predict and train on 'n' branches in trace order, the same as calling
+// predictor_predict_and_update on each. If 'bitmap' is not NULL, bit i
+// of it (bit i % 64 of word i / 64) is set to the i-th prediction; it
+// must hold (n + 63) / 64 words.
+//
+// Returns the number of mispredictions
+//
+uint32_t predictor_predict_batch(struct predictor *p, const uint32_t *pcs, const uint8_t *outcomes,
+                                 size_t n, uint64_t *bitmap);
+
+// predictor_predict_batch that also counts every branch in 'prof' (see
+// profile.h), unless it is NULL
+//
+uint32_t predictor_profile_batch(struct predictor *p, const uint32_t *pcs, const uint8_t *outcomes,
+                                 size_t n, uint64_t *bitmap, struct profile *prof);
+
+// What predictor_lookup found for one branch. predictor_update trains on
+// it instead of repeating the lookup, so no other call on the same
+// predictor may come in between.
+//
+// 'provider' tells which table made the prediction:
+//   Static, Gshare   0
+//   Perceptron       0
+//   Tournament       0 local, 1 global
+//   Bimode           0 not-taken PHT, 1 taken PHT
+//   Custom           0 local, 1 + the Bimode provider
+//   TAGE             the tagged component, -1 for the base predictor
+//
+// Each type names its providers in its descriptor, by provider + 1.
+//
+#define PREDICTOR_PROVIDERS (TAGE_COMPONENTS + 1)
+
+struct predictor_token
+{
+  uint8_t prediction;                   // TAKEN or NOTTAKEN
+  uint8_t aux;                          // Per-type extra state
+  int provider;
+  uint32_t index[TAGE_COMPONENTS + 1];  // Table indices, layout is per type
+  uint32_t tag[TAGE_COMPONENTS];        // Tags of the TAGE components
+  int alt;                              // TAGE alternate component, -1 for the base predictor
+  int sc_sum;                           // TAGE statistical corrector output
+  uint32_t sc_index[TAGE_SC_TABLES];    // TAGE statistical corrector indices
+  uint32_t loop;                        // TAGE loop predictor index and tag
+};
+
+//------------------------------------//
+//        Predictor Registry          //
+//------------------------------------//
+//
+// Every type registers its name, its parameter schema, its entry points,
+// its provider names and its specialized kernels in one descriptor of
+// predictor_types, indexed by the types above. The generic API below
+// only dispatches through it. Adding a type takes its enumerator, its
+// descriptor, and its state and config members in struct predictor and
+// struct predictor_config.
+
+typedef uint32_t (*batch_kernel)(struct predictor *p, const uint32_t *pcs, const uint8_t *outcomes,
+                                 size_t n, uint64_t *bitmap, struct profile *prof);
+
+// A batch kernel built for one configuration, see predictor.c
+struct specialized_kernel;
+
+struct predictor_type
+{
+  const char *name;                     // Name used in output and specs
+  const struct predictor_param *params; // Schema, in positional order
+  int num_params;
+
+  // Bits of tables and history registers of 'cfg'
+  long (*storage_bits)(const struct predictor_config *cfg);
+
+  // Allocate the tables for 'cfg' in a zeroed instance, may be NULL
+  void (*init)(struct predictor *p, const struct predictor_config *cfg);
+  uint8_t (*lookup)(struct predictor *p, uint32_t pc, struct predictor_token *l);
+  void (*update)(struct predictor *p, uint8_t outcome, const struct predictor_token *l);
+  // Free the tables, may be NULL
+  void (*cleanup)(struct predictor *p);
+
+  // The lookup/update loop of predictor_predict_batch
+  batch_kernel batch;
+
+  // Kernels used instead of 'batch' for the configurations they were
+  // built for
+  const struct specialized_kernel *kernels;
+  int num_kernels;
+
+  // Names of the providers by provider + 1, NULL where there is none
+  const char *providers[PREDICTOR_PROVIDERS];
+};
+
+extern const struct predictor_type predictor_types[];
+
+uint8_t predictor_lookup(struct predictor *p, uint32_t pc, struct predictor_token *l);
+
+void predictor_update(struct predictor *p, uint32_t pc, uint8_t outcome,
+                      const struct predictor_token *l);
+
+void predictor_destroy(struct predictor *p);
+
 #endif
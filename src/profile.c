@@ -0,0 +1,200 @@
+//========================================================//
+//  profile.c                                             //
+//  Source file for the per-branch misprediction profiler //
+//========================================================//
+
+#include <stdlib.h>
+#include "profile.h"
+
+// Initial number of slots is 2^PROFILE_MIN_BITS
+#define PROFILE_MIN_BITS 10
+
+static inline uint32_t
+slot_of(uint32_t pc, int shift)
+{
+  // Same hash as profile_count
+  return pc * 0x9E3779B1u >> shift;
+}
+
+struct profile *
+profile_create(int type)
+{
+  struct profile *prof = calloc(1, sizeof(*prof));
+  prof->mask = (1u << PROFILE_MIN_BITS) - 1;
+  prof->shift = 32 - PROFILE_MIN_BITS;
+  prof->slots = calloc((size_t)prof->mask + 1, sizeof(*prof->slots));
+  prof->totals = calloc((size_t)prof->mask + 1, sizeof(*prof->totals));
+
+  // Only vote if the type has a choice of providers
+  prof->type = type;
+  int providers = 0;
+  for (int k = 0; k < PROFILE_PROVIDERS; k++) {
+    if (predictor_types[type].providers[k]) {
+      prof->provider = k;
+      providers++;
+    }
+  }
+  prof->vote = providers > 1;
+  return prof;
+}
+
+// Double the number of slots and reinsert every branch
+//
+static void
+grow(struct profile *prof)
+{
+  struct profile_entry *old = prof->slots;
+  struct profile_totals *old_totals = prof->totals;
+  uint32_t old_slots = prof->mask + 1;
+
+  prof->mask = 2 * old_slots - 1;
+  prof->shift--;
+  prof->slots = calloc(2 * (size_t)old_slots, sizeof(*prof->slots));
+  prof->totals = calloc(2 * (size_t)old_slots, sizeof(*prof->totals));
+  for (uint32_t i = 0; i < old_slots; i++) {
+    if (old[i].counts) {
+      uint32_t s = slot_of(old[i].pc, prof->shift);
+      while (prof->slots[s].counts) {
+        s = (s + 1) & prof->mask;
+      }
+      prof->slots[s] = old[i];
+      prof->totals[s] = old_totals[i];
+    }
+  }
+  free(old);
+  free(old_totals);
+}
+
+struct profile_entry *
+profile_insert(struct profile *prof, uint32_t pc)
+{
+  // Keep the table at most half full so probes stay short
+  if (2 * (prof->used + 1) > prof->mask + 1) {
+    grow(prof);
+  }
+  uint32_t s = slot_of(pc, prof->shift);
+  while (prof->slots[s].counts) {
+    s = (s + 1) & prof->mask;
+  }
+  prof->used++;
+  prof->slots[s].pc = pc;
+  prof->slots[s].counts = PROFILE_USED;
+  prof->slots[s].provider = prof->provider;
+  return &prof->slots[s];
+}
+
+void
+profile_spill(struct profile *prof, struct profile_entry *e)
+{
+  struct profile_totals *t = &prof->totals[e - prof->slots];
+  t->executions += e->counts & PROFILE_MASK;
+  t->taken += (e->counts >> PROFILE_FIELD) & PROFILE_MASK;
+  t->mispredictions += (e->counts >> (2 * PROFILE_FIELD)) & PROFILE_MASK;
+  e->counts = PROFILE_USED;
+}
+
+// A branch with its counts added up, as written out
+struct branch
+{
+  uint32_t pc;
+  const char *provider;
+  uint64_t executions;
+  uint64_t taken;
+  uint64_t mispredictions;
+};
+
+// Worst first, then by PC so the order is stable
+//
+static int
+compare_branches(const void *a, const void *b)
+{
+  const struct branch *x = a;
+  const struct branch *y = b;
+  if (x->mispredictions != y->mispredictions) {
+    return x->mispredictions < y->mispredictions ? 1 : -1;
+  }
+  return (x->pc > y->pc) - (x->pc < y->pc);
+}
+
+int
+profile_write(const struct profile *prof, FILE *f, int top, int format)
+{
+  struct branch *sorted = malloc((prof->used + 1) * sizeof(*sorted));
+  const char *const *names = predictor_types[prof->type].providers;
+  uint32_t n = 0;
+  for (uint32_t i = 0; i <= prof->mask; i++) {
+    const struct profile_entry *e = &prof->slots[i];
+    const struct profile_totals *t = &prof->totals[i];
+    if (e->counts) {
+      struct branch *b = &sorted[n++];
+      b->pc = e->pc;
+      // A type without a base predictor has no name for slot 0
+      b->provider = names[e->provider] ? names[e->provider] : "none";
+      b->executions = t->executions + (e->counts & PROFILE_MASK);
+      b->taken = t->taken + ((e->counts >> PROFILE_FIELD) & PROFILE_MASK);
+      b->mispredictions = t->mispredictions + ((e->counts >> (2 * PROFILE_FIELD)) & PROFILE_MASK);
+    }
+  }
+  qsort(sorted, n, sizeof(*sorted), compare_branches);
+
+  uint64_t branches = 0, mispredictions = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    branches += sorted[i].executions;
+    mispredictions += sorted[i].mispredictions;
+  }
+  if (top > 0 && (uint32_t)top < n) {
+    n = top;
+  }
+
+  if (format == PROFILE_JSON) {
+    fprintf(f, "{\"branches\": %llu, \"mispredictions\": %llu, \"static_branches\": %u, \"top\": [",
+            (unsigned long long)branches, (unsigned long long)mispredictions, prof->used);
+  } else {
+    fprintf(f, "pc,executions,mispredictions,misprediction_rate,taken_rate,share,"
+               "cumulative_share,provider\n");
+  }
+
+  uint64_t cumulative = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    const struct branch *b = &sorted[i];
+    cumulative += b->mispredictions;
+
+    // Rates and shares in percent like the misprediction rate of the
+    // predictor binary
+    double total = mispredictions ? (double)mispredictions : 1.0;
+    double rate = 100.0 * b->mispredictions / b->executions;
+    double taken = 100.0 * b->taken / b->executions;
+    double share = 100.0 * b->mispredictions / total;
+    double cumulative_share = 100.0 * cumulative / total;
+
+    if (format == PROFILE_JSON) {
+      fprintf(f, "%s\n  {\"pc\": \"0x%x\", \"executions\": %llu, \"mispredictions\": %llu, "
+                 "\"misprediction_rate\": %.3f, \"taken_rate\": %.3f, \"share\": %.3f, "
+                 "\"cumulative_share\": %.3f, \"provider\": \"%s\"}",
+              i ? "," : "", b->pc, (unsigned long long)b->executions,
+              (unsigned long long)b->mispredictions, rate, taken, share,
+              cumulative_share, b->provider);
+    } else {
+      fprintf(f, "0x%x,%llu,%llu,%.3f,%.3f,%.3f,%.3f,%s\n", b->pc,
+              (unsigned long long)b->executions, (unsigned long long)b->mispredictions, rate,
+              taken, share, cumulative_share, b->provider);
+    }
+  }
+  if (format == PROFILE_JSON) {
+    fprintf(f, "\n]}\n");
+  }
+
+  free(sorted);
+  return ferror(f) ? -1 : 0;
+}
+
+void
+profile_destroy(struct profile *prof)
+{
+  if (!prof) {
+    return;
+  }
+  free(prof->slots);
+  free(prof->totals);
+  free(prof);
+}
@@ -0,0 +1,135 @@
+//========================================================//
+//  profile.h                                             //
+//  Header file for the per-branch misprediction profiler //
+//                                                        //
+//  Counts are kept per static branch (PC) in an open-    //
+//  addressing hash table of 16-byte entries. The batch   //
+//  kernels count each branch inline as they go, see      //
+//  predictor_profile_batch                               //
+//========================================================//
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "predictor.h"
+
+// Output formats of profile_write
+#define PROFILE_CSV  0
+#define PROFILE_JSON 1
+
+// Providers range from -1 (the TAGE base predictor) to the last TAGE
+// component and are counted at provider + 1
+#define PROFILE_PROVIDERS PREDICTOR_PROVIDERS
+
+// The counts of an entry are packed into one word so that a branch is
+// counted with a single add: the executions from bit 0, the taken
+// branches from bit PROFILE_FIELD and the mispredictions from bit
+// 2 * PROFILE_FIELD. They are moved to the 64-bit totals before the
+// executions can overflow. PROFILE_USED marks a slot in use.
+#define PROFILE_FIELD 21
+#define PROFILE_MASK  ((1ULL << PROFILE_FIELD) - 1)
+#define PROFILE_SPILL (1ULL << (PROFILE_FIELD - 1))
+#define PROFILE_USED  (1ULL << 63)
+
+// A static branch, its slot is empty while counts is 0
+struct profile_entry
+{
+  uint32_t pc;
+  uint16_t votes;     // Majority vote for 'provider'
+  uint8_t provider;   // Provider + 1 that made most of the predictions
+  uint64_t counts;
+};
+
+// Counts of an entry moved out of it, kept apart so the hot entries
+// stay small
+struct profile_totals
+{
+  uint64_t executions;
+  uint64_t taken;
+  uint64_t mispredictions;
+};
+
+struct profile
+{
+  struct profile_entry *slots;
+  struct profile_totals *totals;  // Per slot
+  uint32_t mask;      // Number of slots - 1
+  int shift;          // 32 - log2(number of slots)
+  uint32_t used;      // Number of static branches
+  int type;           // Type of the predictor profiled
+  int vote;           // True if the type has more than one provider
+  uint8_t provider;   // Provider + 1 of a type that has only one
+};
+
+// Returns a profile for a predictor of 'type'
+//
+struct profile *profile_create(int type);
+
+// Add an entry for a 'pc' that is not in the table yet
+//
+// Returns the new entry
+//
+struct profile_entry *profile_insert(struct profile *prof, uint32_t pc);
+
+// Move the counts of 'e' to its totals
+//
+void profile_spill(struct profile *prof, struct profile_entry *e);
+
+// Count one branch. This is called for every branch of a profiled run,
+// so only the lookup of a known PC is inline and a branch costs one
+// add, plus the vote for the types with more than one provider.
+//
+static inline void
+profile_count(struct profile *prof, uint32_t pc, uint8_t outcome, uint8_t prediction,
+              int provider)
+{
+  // Fibonacci hashing, the low PC bits alone cluster on aligned code
+  uint32_t s = pc * 0x9E3779B1u >> prof->shift;
+  struct profile_entry *e;
+  for (;;) {
+    e = &prof->slots[s];
+    if (e->pc == pc && e->counts) {
+      break;
+    }
+    if (!e->counts) {
+      e = profile_insert(prof, pc);
+      break;
+    }
+    s = (s + 1) & prof->mask;
+  }
+
+  e->counts += 1 + ((uint64_t)outcome << PROFILE_FIELD) +
+               ((uint64_t)(prediction != outcome) << (2 * PROFILE_FIELD));
+  if (e->counts & PROFILE_SPILL) {
+    profile_spill(prof, e);
+  }
+
+  if (prof->vote) {
+    // Boyer-Moore majority vote, which finds the provider of more than
+    // half the predictions if there is one. A provider out of range is
+    // counted as the base.
+    uint8_t k = (unsigned)(provider + 1) < PROFILE_PROVIDERS ? provider + 1 : 0;
+    if (e->provider == k) {
+      e->votes += e->votes < UINT16_MAX;
+    } else if (e->votes) {
+      e->votes--;
+    } else {
+      e->provider = k;
+      e->votes = 1;
+    }
+  }
+}
+
+// Write the 'top' branches with the most mispredictions to 'f', worst
+// first, with their share of all mispredictions and the provider that
+// made most of their predictions. 'top' <= 0 writes every branch.
+//
+// Returns 0 on success
+//
+int profile_write(const struct profile *prof, FILE *f, int top, int format);
+
+void profile_destroy(struct profile *prof);
+
+#endif
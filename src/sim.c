@@ -0,0 +1,152 @@
+//========================================================//
+//  sim.c                                                 //
+//  Source file for running predictors over traces        //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sim.h"
+#include "trace.h"
+
+int
+sim_parse_config(const char *spec, struct predictor_config *cfg)
+{
+  size_t len = strcspn(spec, ":,");
+  int type = predictor_type_find(spec, len);
+  if (type < 0) {
+    return 0;
+  }
+  predictor_config_init(cfg, type);
+
+  // Index of the next positional parameter in the type's schema
+  const struct predictor_type *t = &predictor_types[type];
+  int next = 0;
+  while (spec[len] == ':' || spec[len] == ',') {
+    spec += len + 1;
+    len = strcspn(spec, ":,");
+
+    const struct predictor_param *param;
+    const char *value = memchr(spec, '=', len);
+    if (value) {
+      param = predictor_param_find(type, spec, value - spec);
+      value++;
+    } else {
+      param = next < t->num_params ? &t->params[next++] : NULL;
+      value = spec;
+    }
+
+    char *end;
+    long v = strtol(value, &end, 10);
+    if (!param || end == value || end != spec + len || v < param->min || v > param->max) {
+      return 0;
+    }
+    *predictor_param_ref(cfg, param) = (int)v;
+  }
+  return spec[len] == '\0';
+}
+
+size_t
+sim_spec_length(const char *list)
+{
+  size_t len = strcspn(list, ",");
+  while (list[len] == ',') {
+    // "<param>=<value>" with no ':' before the '=' continues the spec
+    const char *next = list + len + 1;
+    size_t next_len = strcspn(next, ",");
+    const char *eq = memchr(next, '=', next_len);
+    if (!eq || memchr(next, ':', eq - next)) {
+      break;
+    }
+    len += 1 + next_len;
+  }
+  return len;
+}
+
+void
+sim_format_config(const struct predictor_config *cfg, char *buf, size_t len)
+{
+  const struct predictor_type *t = &predictor_types[cfg->type];
+  size_t n = snprintf(buf, len, "%s", t->name);
+  for (char *s = buf; *s; s++) {
+    *s = tolower((unsigned char)*s);
+  }
+  for (int i = 0; i < t->num_params && n < len; i++) {
+    const struct predictor_param *param = &t->params[i];
+    int value = *predictor_param_ref((struct predictor_config *)cfg, param);
+    n += snprintf(buf + n, len - n, ":%s=%d", param->name, value);
+  }
+}
+
+void
+sim_resolve_trace(const char *arg, const char *dir, char *path, size_t path_len,
+                  char *name, size_t name_len)
+{
+  if (strchr(arg, '/') || access(arg, R_OK) == 0) {
+    snprintf(path, path_len, "%s", arg);
+  } else {
+    snprintf(path, path_len, "%s/%s.bpt", dir, arg);
+    if (access(path, R_OK) != 0) {
+      snprintf(path, path_len, "%s/%s.bz2", dir, arg);
+    }
+  }
+
+  const char *base = strrchr(arg, '/') ? strrchr(arg, '/') + 1 : arg;
+  const char *ext = strrchr(base, '.');
+  if (ext && (!strcmp(ext, ".bz2") || !strcmp(ext, ".bpt"))) {
+    snprintf(name, name_len, "%.*s", (int)(ext - base), base);
+  } else {
+    snprintf(name, name_len, "%s", base);
+  }
+}
+
+double
+sim_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+sim_run(const struct predictor_config *cfg, const char *path,
+        struct profile *prof, struct sim_result *res)
+{
+  memset(res, 0, sizeof(*res));
+  double start = sim_now();
+
+  struct predictor *p = predictor_create(cfg);
+  if (!p) {
+    snprintf(res->error, sizeof(res->error), "unknown predictor type %d", cfg->type);
+    return -1;
+  }
+  struct trace *t = trace_open(path);
+  if (!t) {
+    snprintf(res->error, sizeof(res->error), "cannot open trace");
+    predictor_destroy(p);
+    return -1;
+  }
+
+  const uint32_t *pcs;
+  const uint8_t *outcomes;
+  size_t n;
+
+  while ((n = trace_next(t, &pcs, &outcomes)) > 0) {
+    res->mispredictions += predictor_profile_batch(p, pcs, outcomes, n, NULL, prof);
+    res->branches += n;
+  }
+
+  int status = 0;
+  if (trace_error(t)) {
+    snprintf(res->error, sizeof(res->error), "%s", trace_error(t));
+    status = -1;
+  }
+  trace_close(t);
+  predictor_destroy(p);
+
+  res->seconds = sim_now() - start;
+  return status;
+}
@@ -0,0 +1,62 @@
+//========================================================//
+//  sim.h                                                 //
+//  Header file for running predictors over traces        //
+//========================================================//
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include "predictor.h"
+#include "profile.h"
+
+struct sim_result
+{
+  uint64_t branches;        // Number of branches in the trace
+  uint64_t mispredictions;  // Number of wrong predictions
+  double seconds;           // Wall time of the whole run
+  char error[128];          // Set when the run failed
+};
+
+// Parse a "<type>[:<value>]..." spec into 'cfg'. Values fill the
+// parameters of the type in the order of its registered schema, and a
+// value can also be given by name as "<param>=<value>", so "gshare:13"
+// and "tournament:lIndexBits=11" are both valid. Parameters may be
+// separated by ',' as well, as in "tage:T0_PC=11,tag_bit=10". Omitted
+// parameters keep their defaults.
+//
+// Returns True if Successful
+//
+int sim_parse_config(const char *spec, struct predictor_config *cfg);
+
+// Returns the length of the first spec of a ','-separated list of
+// specs. A following "<param>=<value>" belongs to the same spec, so
+// "tage:tag_bit=10,L7=120,gshare" splits after "L7=120".
+//
+size_t sim_spec_length(const char *list);
+
+// Write 'cfg' to 'buf' as a spec accepted by sim_parse_config, naming
+// every parameter
+//
+void sim_format_config(const struct predictor_config *cfg, char *buf, size_t len);
+
+// Resolve a trace argument to a path, a bare name is looked for as
+// <dir>/<name>.bpt and then <dir>/<name>.bz2. 'name' is set to the file
+// name without the trace extension.
+//
+void sim_resolve_trace(const char *arg, const char *dir, char *path, size_t path_len,
+                       char *name, size_t name_len);
+
+// Monotonic wall clock in seconds
+//
+double sim_now(void);
+
+// Run a fresh predictor built from 'cfg' over the trace at 'path',
+// counting every branch in 'prof' unless it is NULL
+//
+// Returns 0 on success, or -1 with res->error describing the failure
+//
+int sim_run(const struct predictor_config *cfg, const char *path,
+            struct profile *prof, struct sim_result *res);
+
+#endif
@@ -0,0 +1,47 @@
+//========================================================//
+//  simd.h                                                //
+//  Helpers for the SIMD kernels                          //
+//                                                        //
+//  Kernels are compiled per function with target()       //
+//  attributes and picked at runtime, so the build does   //
+//  not depend on the host's instruction set. Setting     //
+//  BP_NO_SIMD in the environment forces the scalar code. //
+//========================================================//
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(__x86_64__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+#include <stdlib.h>
+
+static inline int
+cpu_has_ssse3(void)
+{
+#if HAVE_X86_SIMD
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("ssse3") && !getenv("BP_NO_SIMD");
+#else
+  return 0;
+#endif
+}
+
+static inline int
+cpu_has_avx2(void)
+{
+#if HAVE_X86_SIMD
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && !getenv("BP_NO_SIMD");
+#else
+  return 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,298 @@
+//========================================================//
+//  suite.c                                               //
+//  Runs a matrix of predictor configs over a set of      //
+//  traces in parallel and writes results/<name>.csv      //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "predictor.h"
+#include "sim.h"
+#include "pool.h"
+#include "trace.h"
+
+// One column of the matrix, written to <results>/<name>.csv
+struct suite_config
+{
+  char name[64];
+  struct predictor_config cfg;
+};
+
+// One row of the matrix
+struct suite_trace
+{
+  char name[64];
+  char path[4096];
+};
+
+struct suite_config *configs;
+int num_configs = 0;
+struct suite_trace *traces;
+int num_traces = 0;
+
+struct sim_result *results;  // num_configs x num_traces, config major
+pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const char *default_traces = "fp_1,fp_2,int_1,int_2,mm_1,mm_2";
+const char *trace_dir = "../traces";
+const char *results_dir = "../results";
+
+// With --profile every job also writes <results>/<name>.<trace>.profile.csv
+int profile_top = 0;
+
+void
+usage()
+{
+  fprintf(stderr,"Usage: suite <options> [<name>=]<type>[:<param>...] ...\n");
+  fprintf(stderr," Runs every <type> over every trace, writing <results>/<name>.csv\n");
+  fprintf(stderr," Options:\n");
+  fprintf(stderr," --help             Print this message\n");
+  fprintf(stderr," --threads=<n>      Jobs run in parallel, defaults to the CPU count\n");
+  fprintf(stderr," --traces=<t>,...   Trace names or paths (default %s)\n", default_traces);
+  fprintf(stderr," --trace-dir=<dir>  Where trace names are looked up (default %s)\n", trace_dir);
+  fprintf(stderr," --results=<dir>    Where the CSV files go (default %s)\n", results_dir);
+  fprintf(stderr," --matrix=<file>    Read more configs from <file>, one per line\n");
+  fprintf(stderr," --profile[=<n>]    Also write the <n> (default 20, 0 for all) worst\n"
+                 "                    branches of each run to <name>.<trace>.profile.csv\n");
+  fprintf(stderr," A name without an extension is looked for as <name>.bpt, then <name>.bz2\n");
+}
+
+// Add a "[<name>=]<type>" config to the matrix
+//
+// Returns True if Successful
+//
+int
+add_config(const char *spec)
+{
+  // A '=' after the first ':' or ',' belongs to a named parameter
+  const char *eq = strchr(spec, '=');
+  const char *colon = strpbrk(spec, ":,");
+  if (eq && colon && colon < eq) {
+    eq = NULL;
+  }
+  struct predictor_config cfg;
+  if (!sim_parse_config(eq ? eq + 1 : spec, &cfg)) {
+    return 0;
+  }
+
+  configs = realloc(configs, (num_configs + 1) * sizeof(*configs));
+  struct suite_config *c = &configs[num_configs++];
+  c->cfg = cfg;
+
+  if (eq) {
+    snprintf(c->name, sizeof(c->name), "%.*s", (int)(eq - spec), spec);
+  } else {
+    // Default to the lower case spec, matching run_all.py
+    snprintf(c->name, sizeof(c->name), "%s", spec);
+    for (char *s = c->name; *s; s++) {
+      *s = *s == ':' ? '_' : tolower((unsigned char)*s);
+    }
+  }
+  return 1;
+}
+
+// Add every non-empty line of 'path' that is not a # comment
+//
+// Returns True if Successful
+//
+int
+add_matrix(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return 0;
+  }
+
+  char line[256];
+  int ok = 1;
+  while (ok && fgets(line, sizeof(line), f)) {
+    char *s = line + strspn(line, " \t");
+    s[strcspn(s, " \t\r\n#")] = '\0';
+    if (*s && !add_config(s)) {
+      fprintf(stderr, "%s: bad config \"%s\"\n", path, s);
+      ok = 0;
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+// Add the comma separated trace list
+//
+void
+add_traces(const char *list)
+{
+  while (*list) {
+    size_t len = strcspn(list, ",");
+    if (len > 0) {
+      traces = realloc(traces, (num_traces + 1) * sizeof(*traces));
+      struct suite_trace *t = &traces[num_traces++];
+      char arg[4096];
+      snprintf(arg, sizeof(arg), "%.*s", (int)len, list);
+      sim_resolve_trace(arg, trace_dir, t->path, sizeof(t->path), t->name, sizeof(t->name));
+    }
+    list += len + (list[len] == ',');
+  }
+}
+
+// Write the profile of one job, a failure is reported as the job's
+// error
+//
+void
+write_profile(struct profile *prof, struct suite_config *c, struct suite_trace *t,
+              struct sim_result *res)
+{
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s.%s.profile.csv", results_dir, c->name, t->name);
+  FILE *f = fopen(path, "w");
+  if (!f || profile_write(prof, f, profile_top, PROFILE_CSV) != 0 || fclose(f) != 0) {
+    snprintf(res->error, sizeof(res->error), "cannot write %s", path);
+  }
+}
+
+void
+run_job(void *arg, size_t index, int worker)
+{
+  struct suite_config *c = &configs[index / num_traces];
+  struct suite_trace *t = &traces[index % num_traces];
+  struct sim_result *res = &results[index];
+
+  struct profile *prof = profile_top ? profile_create(c->cfg.type) : NULL;
+  sim_run(&c->cfg, t->path, prof, res);
+  if (prof) {
+    if (!res->error[0]) {
+      write_profile(prof, c, t, res);
+    }
+    profile_destroy(prof);
+  }
+
+  pthread_mutex_lock(&print_lock);
+  if (res->error[0]) {
+    fprintf(stderr, "%-16s %-10s failed: %s\n", c->name, t->name, res->error);
+  } else {
+    printf("%-16s %-10s %10llu %10llu %8.3f %8.3fs %8.2f Mbr/s\n", c->name, t->name,
+           (unsigned long long)res->branches, (unsigned long long)res->mispredictions,
+           100*((double)res->mispredictions / (double)res->branches), res->seconds,
+           res->branches / res->seconds * 1e-6);
+    fflush(stdout);
+  }
+  pthread_mutex_unlock(&print_lock);
+}
+
+// Write the results of config 'k' in the layout of run_all.py
+//
+// Returns True if Successful
+//
+int
+write_csv(int k)
+{
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s.csv", results_dir, configs[k].name);
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return 0;
+  }
+
+  uint64_t branches = 0, incorrect = 0;
+  fprintf(f, "benchmark,branches,incorrect,misprediction_rate\r\n");
+  for (int i = 0; i < num_traces; i++) {
+    struct sim_result *res = &results[k * num_traces + i];
+    // Same rate as printed by the predictor binary
+    double rate = 100*((double)res->mispredictions / (double)res->branches);
+    fprintf(f, "%s,%llu,%llu,%.3f\r\n", traces[i].name, (unsigned long long)res->branches,
+            (unsigned long long)res->mispredictions, rate);
+    branches += res->branches;
+    incorrect += res->mispredictions;
+  }
+  fprintf(f, "overall,%llu,%llu,%.3f\r\n", (unsigned long long)branches,
+          (unsigned long long)incorrect, incorrect * 100.0 / branches);
+
+  return fclose(f) == 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int threads = 0;
+  const char *trace_list = default_traces;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--help")) {
+      usage();
+      exit(0);
+    } else if (!strncmp(argv[i], "--threads=", 10)) {
+      threads = atoi(argv[i] + 10);
+    } else if (!strncmp(argv[i], "--traces=", 9)) {
+      trace_list = argv[i] + 9;
+    } else if (!strncmp(argv[i], "--trace-dir=", 12)) {
+      trace_dir = argv[i] + 12;
+    } else if (!strncmp(argv[i], "--results=", 10)) {
+      results_dir = argv[i] + 10;
+    } else if (!strcmp(argv[i], "--profile")) {
+      profile_top = 20;
+    } else if (!strncmp(argv[i], "--profile=", 10)) {
+      profile_top = atoi(argv[i] + 10) > 0 ? atoi(argv[i] + 10) : -1;
+    } else if (!strncmp(argv[i], "--matrix=", 9)) {
+      if (!add_matrix(argv[i] + 9)) {
+        exit(1);
+      }
+    } else if (strncmp(argv[i], "--", 2) && add_config(argv[i])) {
+      continue;
+    } else {
+      fprintf(stderr, "Unrecognized argument %s\n", argv[i]);
+      usage();
+      exit(1);
+    }
+  }
+
+  add_traces(trace_list);
+  if (num_configs == 0 || num_traces == 0) {
+    usage();
+    exit(1);
+  }
+
+  // Parallelism comes from running jobs side by side, so every trace
+  // is decoded on its own reader thread only
+  trace_set_threads(1);
+
+  size_t jobs = (size_t)num_configs * num_traces;
+  results = calloc(jobs, sizeof(*results));
+  if (threads <= 0) {
+    threads = pool_default_workers();
+  }
+  if ((size_t)threads > jobs) {
+    threads = (int)jobs;
+  }
+
+  double start = sim_now();
+  pool_run(threads, jobs, run_job, NULL);
+  double wall = sim_now() - start;
+
+  uint64_t branches = 0;
+  int failed = 0;
+  for (int k = 0; k < num_configs; k++) {
+    int ok = 1;
+    for (int i = 0; i < num_traces; i++) {
+      struct sim_result *res = &results[k * num_traces + i];
+      ok &= !res->error[0];
+      branches += res->branches;
+    }
+    if (!ok || !write_csv(k)) {
+      failed = 1;
+    }
+  }
+
+  printf("%zu jobs on %d threads, %llu branches in %.3fs (%.2f Mbr/s)\n",
+         jobs, threads, (unsigned long long)branches, wall, branches / wall * 1e-6);
+
+  free(results);
+  free(configs);
+  free(traces);
+  return failed;
+}
@@ -0,0 +1,332 @@
+//========================================================//
+//  sweep.c                                               //
+//  Sweeps a grid of predictor parameters under a storage //
+//  budget and reports the bits vs. MPKI Pareto frontier  //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "predictor.h"
+#include "sim.h"
+#include "pool.h"
+#include "trace.h"
+
+// Refuse grids that would take all night by accident
+#define MAX_POINTS (1 << 20)
+
+// The values one parameter is swept over
+struct axis
+{
+  const struct predictor_param *param;
+  int *values;
+  int count;
+};
+
+// One configuration of the grid
+struct point
+{
+  struct predictor_config cfg;
+  long bits;                // Storage of the configuration
+  uint64_t branches;        // Summed over all traces
+  uint64_t mispredictions;
+  double mpki;              // Mispredictions per 1000 branches
+  int failed;
+};
+
+struct axis axes[64];
+int num_axes = 0;
+
+struct point *points;
+size_t num_points = 0;
+
+char (*trace_paths)[4096];
+int num_traces = 0;
+
+pthread_mutex_t point_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const char *default_traces = "fp_1,fp_2,int_1,int_2,mm_1,mm_2";
+const char *trace_dir = "../traces";
+
+void
+usage()
+{
+  fprintf(stderr,"Usage: sweep <options> <type> [<param>=<values> ...]\n");
+  fprintf(stderr," Simulates every combination of the given values that fits the budget\n");
+  fprintf(stderr," and prints the Pareto frontier of storage bits vs. MPKI\n");
+  fprintf(stderr," <values> is one of  <v>  <v>,<v>,...  <lo>-<hi>  <lo>-<hi>/<step>\n");
+  fprintf(stderr," Options:\n");
+  fprintf(stderr," --help             Print this message\n");
+  fprintf(stderr," --budget=<bits>    Storage budget (default %d)\n", PREDICTOR_BUDGET_BITS);
+  fprintf(stderr," --threads=<n>      Jobs run in parallel, defaults to the CPU count\n");
+  fprintf(stderr," --traces=<t>,...   Trace names or paths (default %s)\n", default_traces);
+  fprintf(stderr," --trace-dir=<dir>  Where trace names are looked up (default %s)\n", trace_dir);
+  fprintf(stderr," --all              Print every simulated point, not only the frontier\n");
+  fprintf(stderr," --csv=<file>       Write every simulated point to <file>\n");
+  fprintf(stderr," MPKI counts mispredictions per 1000 branches, the traces hold no\n"
+                 " other instructions\n");
+}
+
+// Parse "<param>=<values>" for predictor type 'type' into a new axis
+//
+// Returns True if Successful
+//
+int
+add_axis(int type, const char *arg)
+{
+  const char *eq = strchr(arg, '=');
+  if (!eq || num_axes == sizeof(axes) / sizeof(axes[0])) {
+    return 0;
+  }
+  struct axis *a = &axes[num_axes];
+  a->param = predictor_param_find(type, arg, eq - arg);
+  if (!a->param) {
+    fprintf(stderr, "%s has no parameter %.*s\n", predictor_types[type].name, (int)(eq - arg), arg);
+    return 0;
+  }
+
+  const char *s = eq + 1;
+  while (*s) {
+    char *end;
+    long lo = strtol(s, &end, 10), hi = lo, step = 1;
+    if (end == s) {
+      return 0;
+    }
+    if (*end == '-') {
+      s = end + 1;
+      hi = strtol(s, &end, 10);
+      if (end == s) {
+        return 0;
+      }
+      if (*end == '/') {
+        s = end + 1;
+        step = strtol(s, &end, 10);
+        if (end == s || step <= 0) {
+          return 0;
+        }
+      }
+    }
+    if (*end != ',' && *end != '\0') {
+      return 0;
+    }
+    for (long v = lo; v <= hi; v += step) {
+      if (v < a->param->min || v > a->param->max) {
+        fprintf(stderr, "%s must be within %d-%d\n", a->param->name,
+                a->param->min, a->param->max);
+        return 0;
+      }
+      a->values = realloc(a->values, (a->count + 1) * sizeof(int));
+      a->values[a->count++] = (int)v;
+    }
+    s = end + (*end == ',');
+  }
+
+  num_axes += a->count > 0;
+  return a->count > 0;
+}
+
+// Expand the grid, keeping the points within 'budget'
+//
+// Returns the number of points dropped for their storage
+//
+size_t
+build_points(const struct predictor_config *base, long budget)
+{
+  size_t total = 1, dropped = 0;
+  for (int i = 0; i < num_axes; i++) {
+    total *= axes[i].count;
+    if (total > MAX_POINTS) {
+      fprintf(stderr, "The grid has more than %d points\n", MAX_POINTS);
+      exit(1);
+    }
+  }
+
+  points = calloc(total, sizeof(*points));
+  for (size_t n = 0; n < total; n++) {
+    struct predictor_config cfg = *base;
+    size_t rest = n;
+    for (int i = num_axes - 1; i >= 0; i--) {
+      *predictor_param_ref(&cfg, axes[i].param) = axes[i].values[rest % axes[i].count];
+      rest /= axes[i].count;
+    }
+
+    long bits = predictor_storage_bits(&cfg);
+    if (bits > budget) {
+      dropped++;
+      continue;
+    }
+    points[num_points].cfg = cfg;
+    points[num_points].bits = bits;
+    num_points++;
+  }
+  return dropped;
+}
+
+void
+run_job(void *arg, size_t index, int worker)
+{
+  struct point *pt = &points[index / num_traces];
+  struct sim_result res;
+
+  if (sim_run(&pt->cfg, trace_paths[index % num_traces], NULL, &res) != 0) {
+    fprintf(stderr, "%s: %s\n", trace_paths[index % num_traces], res.error);
+  }
+
+  pthread_mutex_lock(&point_lock);
+  pt->branches += res.branches;
+  pt->mispredictions += res.mispredictions;
+  pt->failed |= res.error[0] != '\0';
+  pthread_mutex_unlock(&point_lock);
+}
+
+// Order by storage, then MPKI
+//
+int
+compare_points(const void *a, const void *b)
+{
+  const struct point *x = a, *y = b;
+  if (x->bits != y->bits) {
+    return x->bits < y->bits ? -1 : 1;
+  }
+  return (x->mpki > y->mpki) - (x->mpki < y->mpki);
+}
+
+void
+print_point(const struct point *pt)
+{
+  char spec[512];
+  sim_format_config(&pt->cfg, spec, sizeof(spec));
+  printf("%10ld %10.3f %12llu  %s\n", pt->bits, pt->mpki,
+         (unsigned long long)pt->mispredictions, spec);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int threads = 0, all = 0;
+  long budget = PREDICTOR_BUDGET_BITS;
+  const char *trace_list = default_traces;
+  const char *csv_path = NULL;
+  struct predictor_config base;
+  int have_type = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--help")) {
+      usage();
+      exit(0);
+    } else if (!strncmp(argv[i], "--budget=", 9)) {
+      budget = atol(argv[i] + 9);
+    } else if (!strncmp(argv[i], "--threads=", 10)) {
+      threads = atoi(argv[i] + 10);
+    } else if (!strncmp(argv[i], "--traces=", 9)) {
+      trace_list = argv[i] + 9;
+    } else if (!strncmp(argv[i], "--trace-dir=", 12)) {
+      trace_dir = argv[i] + 12;
+    } else if (!strcmp(argv[i], "--all")) {
+      all = 1;
+    } else if (!strncmp(argv[i], "--csv=", 6)) {
+      csv_path = argv[i] + 6;
+    } else if (!have_type && strncmp(argv[i], "--", 2) && sim_parse_config(argv[i], &base)) {
+      have_type = 1;
+    } else if (have_type && add_axis(base.type, argv[i])) {
+      continue;
+    } else {
+      fprintf(stderr, "Unrecognized argument %s\n", argv[i]);
+      usage();
+      exit(1);
+    }
+  }
+  if (!have_type) {
+    usage();
+    exit(1);
+  }
+
+  while (*trace_list) {
+    size_t len = strcspn(trace_list, ",");
+    if (len > 0) {
+      char arg[4096], name[256];
+      snprintf(arg, sizeof(arg), "%.*s", (int)len, trace_list);
+      trace_paths = realloc(trace_paths, (num_traces + 1) * sizeof(*trace_paths));
+      sim_resolve_trace(arg, trace_dir, trace_paths[num_traces++], sizeof(*trace_paths),
+                        name, sizeof(name));
+    }
+    trace_list += len + (trace_list[len] == ',');
+  }
+  if (num_traces == 0) {
+    usage();
+    exit(1);
+  }
+
+  size_t dropped = build_points(&base, budget);
+  printf("%zu points, %zu over the %ld bit budget skipped\n",
+         num_points + dropped, dropped, budget);
+  if (num_points == 0) {
+    return 1;
+  }
+
+  size_t jobs = num_points * num_traces;
+  if (threads <= 0) {
+    threads = pool_default_workers();
+  }
+  if ((size_t)threads > jobs) {
+    threads = (int)jobs;
+  }
+  trace_set_threads(1);
+
+  double start = sim_now();
+  pool_run(threads, jobs, run_job, NULL);
+  double wall = sim_now() - start;
+  printf("%zu jobs on %d threads in %.3fs\n", jobs, threads, wall);
+
+  int failed = 0;
+  for (size_t i = 0; i < num_points; i++) {
+    struct point *pt = &points[i];
+    pt->mpki = pt->branches ? 1000.0 * pt->mispredictions / pt->branches : 0;
+    failed |= pt->failed;
+  }
+  if (failed) {
+    return 1;
+  }
+  qsort(points, num_points, sizeof(*points), compare_points);
+
+  if (csv_path) {
+    FILE *f = fopen(csv_path, "w");
+    if (!f) {
+      perror(csv_path);
+      return 1;
+    }
+    fprintf(f, "config,bits,branches,incorrect,mpki\n");
+    for (size_t i = 0; i < num_points; i++) {
+      char spec[512];
+      sim_format_config(&points[i].cfg, spec, sizeof(spec));
+      fprintf(f, "%s,%ld,%llu,%llu,%.3f\n", spec, points[i].bits,
+              (unsigned long long)points[i].branches,
+              (unsigned long long)points[i].mispredictions, points[i].mpki);
+    }
+    fclose(f);
+  }
+
+  printf("\n%10s %10s %12s  %s\n", "Bits", "MPKI", "Incorrect", "Config");
+  if (all) {
+    for (size_t i = 0; i < num_points; i++) {
+      print_point(&points[i]);
+    }
+    printf("\nPareto frontier:\n");
+  }
+
+  // Sorted by storage, a point is on the frontier if it beats every
+  // smaller one
+  double best = -1;
+  for (size_t i = 0; i < num_points; i++) {
+    if (best < 0 || points[i].mpki < best) {
+      best = points[i].mpki;
+      print_point(&points[i]);
+    }
+  }
+
+  free(points);
+  free(trace_paths);
+  return 0;
+}
@@ -0,0 +1,908 @@
+//========================================================//
+//  trace.c                                               //
+//  Source file for the branch trace readers              //
+//                                                        //
+//  Text and bzip2 traces are decoded and parsed on a     //
+//  reader thread, packed binary traces are mmap'ed and   //
+//  decoded straight into batches                         //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <bzlib.h>
+#include "trace.h"
+#include "bz2blocks.h"
+#include "parse.h"
+#include "perfstat.h"
+
+#define TRACE_TEXT    0
+#define TRACE_PACKED  1
+
+// Number of parsed batches the reader thread may run ahead by
+#define TRACE_RING    8
+
+// Mapped pages of a packed trace are dropped behind the decoder in steps
+// of this many bytes, so that the resident set stays the same for a
+// trace of any length
+#define RELEASE_STEP  (64 << 20)
+
+// Raw and decompressed chunk sizes of the reader thread
+#define IN_CHUNK      (1 << 16)
+#define TEXT_CHUNK    (1 << 18)
+
+struct trace_slot
+{
+  uint32_t pcs[TRACE_BATCH];
+  uint8_t outcomes[TRACE_BATCH];
+  size_t n;
+};
+
+struct trace
+{
+  int kind;
+  const char *error;
+
+  uint32_t pcs[TRACE_BATCH];
+  uint8_t outcomes[TRACE_BATCH];
+
+  // Text traces: byte source
+  int fd;
+  int bz2;
+  int bz2_active;
+  bz_stream bzs;
+  uint8_t in[IN_CHUNK];
+  size_t in_pos;
+  size_t in_len;
+  int in_eof;
+  struct parse_state parse;
+
+  // Text traces: block-parallel bzip2 decoding of a mapped file
+  struct bz2_blocks *par;
+  const char *par_buf;
+  size_t par_pos;
+  size_t par_len;
+
+  // Text traces: reader thread and its ring of parsed batches
+  pthread_t reader;
+  int started;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  struct trace_slot ring[TRACE_RING];
+  int head;
+  int tail;
+  int ready;
+  int holding;
+  int done;
+  int stop;
+
+  // Packed traces
+  uint8_t *map;
+  size_t map_len;
+  size_t released;       // Pages before this offset have been dropped
+  const uint8_t *pos;
+  const uint8_t *end;
+  const uint32_t *dict;
+  uint32_t num_pcs;
+  uint64_t remaining;
+  uint32_t index;
+  uint8_t outcome;
+  uint64_t run_left;
+
+  // Phase timing with trace_set_perf. Text traces time the reading and
+  // parsing on the reader thread, packed traces the decoding on the
+  // caller's.
+  struct perf_phase perf[2];
+  int num_perf;
+  struct perf_counters counters;
+};
+
+// 64-bit FNV-1a, chained through 'h' so that it can be computed
+// incrementally
+//
+uint64_t
+bpt_checksum(uint64_t h, const uint8_t *p, size_t len)
+{
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ p[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+#define BPT_CHECKSUM_INIT 0xcbf29ce484222325ULL
+
+static int trace_threads = 0;
+static int trace_perf = 0;
+
+void
+trace_set_threads(int threads)
+{
+  trace_threads = threads;
+}
+
+void
+trace_set_perf(int enable)
+{
+  trace_perf = enable;
+}
+
+static size_t
+trace_fail(struct trace *t, const char *msg)
+{
+  t->error = msg;
+  return 0;
+}
+
+//------------------------------------//
+//            Text Traces             //
+//------------------------------------//
+
+// Fill 'in' with raw bytes from the file, returns 0 at EOF
+//
+static int
+source_fill(struct trace *t)
+{
+  if (t->in_eof) {
+    return 0;
+  }
+  ssize_t r;
+  do {
+    r = read(t->fd, t->in, IN_CHUNK);
+  } while (r < 0 && errno == EINTR);
+  if (r <= 0) {
+    t->in_eof = 1;
+    if (r < 0) {
+      t->error = "read failed";
+    }
+    return 0;
+  }
+  t->in_pos = 0;
+  t->in_len = r;
+  return 1;
+}
+
+static int
+bz2_begin(struct trace *t)
+{
+  memset(&t->bzs, 0, sizeof(t->bzs));
+  if (BZ2_bzDecompressInit(&t->bzs, 0, 0) != BZ_OK) {
+    t->error = "cannot initialize bzip2 decoder";
+    return 0;
+  }
+  t->bz2_active = 1;
+  return 1;
+}
+
+// Read up to 'cap' bytes of trace text, decompressing if the input
+// is bzip2. Concatenated bzip2 streams are decoded back to back.
+//
+// Returns the number of bytes read, 0 at EOF or on error
+//
+static size_t
+source_read(struct trace *t, char *dst, size_t cap)
+{
+  if (t->par) {
+    while (t->par_pos == t->par_len) {
+      long n = bz2_blocks_next(t->par, &t->par_buf, &t->error);
+      if (n <= 0) {
+        return 0;
+      }
+      t->par_pos = 0;
+      t->par_len = n;
+    }
+    size_t n = t->par_len - t->par_pos;
+    n = n < cap ? n : cap;
+    memcpy(dst, t->par_buf + t->par_pos, n);
+    t->par_pos += n;
+    return n;
+  }
+
+  if (!t->bz2) {
+    if (t->in_pos == t->in_len && !source_fill(t)) {
+      return 0;
+    }
+    size_t n = t->in_len - t->in_pos;
+    n = n < cap ? n : cap;
+    memcpy(dst, t->in + t->in_pos, n);
+    t->in_pos += n;
+    return n;
+  }
+
+  t->bzs.next_out = dst;
+  t->bzs.avail_out = cap;
+  while (t->bzs.avail_out == cap) {
+    if (t->bzs.avail_in == 0) {
+      if (!source_fill(t)) {
+        if (t->bz2_active && !t->error) {
+          t->error = "bzip2 stream ends early";
+        }
+        return 0;
+      }
+      t->bzs.next_in = (char *)t->in;
+      t->bzs.avail_in = t->in_len;
+    }
+    if (!t->bz2_active) {
+      // Another stream follows the one that just ended
+      char *next_in = t->bzs.next_in;
+      unsigned avail_in = t->bzs.avail_in;
+      if (!bz2_begin(t)) {
+        return 0;
+      }
+      t->bzs.next_in = next_in;
+      t->bzs.avail_in = avail_in;
+      t->bzs.next_out = dst;
+      t->bzs.avail_out = cap;
+    }
+
+    int ret = BZ2_bzDecompress(&t->bzs);
+    if (ret == BZ_STREAM_END) {
+      BZ2_bzDecompressEnd(&t->bzs);
+      t->bz2_active = 0;
+      if (t->bzs.avail_in == 0 && !source_fill(t)) {
+        break;
+      }
+      if (t->bzs.avail_in == 0) {
+        t->bzs.next_in = (char *)t->in;
+        t->bzs.avail_in = t->in_len;
+      }
+    } else if (ret != BZ_OK) {
+      t->error = "corrupt bzip2 data";
+      return 0;
+    }
+  }
+  return cap - t->bzs.avail_out;
+}
+
+// Publish the slot at 'tail' and wait for the next free one
+//
+// Returns 0 if the consumer asked the reader to stop
+//
+static int
+reader_publish(struct trace *t)
+{
+  pthread_mutex_lock(&t->lock);
+  if (t->ring[t->tail].n > 0) {
+    t->tail = (t->tail + 1) % TRACE_RING;
+    t->ready++;
+    pthread_cond_signal(&t->not_empty);
+  }
+  while (t->ready == TRACE_RING && !t->stop) {
+    pthread_cond_wait(&t->not_full, &t->lock);
+  }
+  int go = !t->stop;
+  pthread_mutex_unlock(&t->lock);
+  t->ring[t->tail].n = 0;
+  return go;
+}
+
+// Reader thread: decompress, split lines and parse them into the ring
+//
+static void *
+reader_main(void *arg)
+{
+  struct trace *t = arg;
+  char *text = malloc(TEXT_CHUNK + 1 + PARSE_PADDING);
+  size_t have = 0;
+  int eof = 0;
+  struct trace_slot *slot = &t->ring[t->tail];
+  slot->n = 0;
+
+  struct perf_counters counters = {{-1, -1, -1, -1}};
+  struct perf_sample sample;
+  if (t->num_perf) {
+    perf_open(&counters);
+  }
+
+  while (!eof) {
+    if (t->num_perf) {
+      perf_begin(&counters, &sample);
+    }
+    size_t r = source_read(t, text + have, TEXT_CHUNK - have);
+    if (t->num_perf) {
+      perf_end(&counters, &t->perf[0], &sample);
+    }
+    if (r == 0) {
+      eof = 1;
+      if (t->error) {
+        break;
+      }
+      // Parse a final line without a newline
+      if (have > 0) {
+        text[have++] = '\n';
+      }
+    }
+    have += r;
+
+    size_t pos = 0;
+    for (;;) {
+      size_t used;
+      if (t->num_perf) {
+        perf_begin(&counters, &sample);
+      }
+      long n = parse_branches(&t->parse, text + pos, have - pos,
+                              slot->pcs + slot->n, slot->outcomes + slot->n,
+                              TRACE_BATCH - slot->n, &used);
+      if (t->num_perf) {
+        perf_end(&counters, &t->perf[1], &sample);
+      }
+      if (n < 0) {
+        t->error = t->parse.error;
+        goto out;
+      }
+      slot->n += n;
+      pos += used;
+      if (slot->n < TRACE_BATCH) {
+        break;
+      }
+      if (!reader_publish(t)) {
+        goto out;
+      }
+      slot = &t->ring[t->tail];
+    }
+
+    have -= pos;
+    if (have == TEXT_CHUNK) {
+      t->error = "trace line too long";
+      break;
+    }
+    memmove(text, text + pos, have);
+  }
+  reader_publish(t);
+
+out:
+  free(text);
+  perf_close(&counters);
+  pthread_mutex_lock(&t->lock);
+  t->done = 1;
+  pthread_cond_signal(&t->not_empty);
+  pthread_mutex_unlock(&t->lock);
+  return NULL;
+}
+
+static int
+text_open(struct trace *t, int fd)
+{
+  t->kind = TRACE_TEXT;
+  t->fd = fd;
+
+  // Sniff the first chunk for a bzip2 stream header
+  if (!t->par && source_fill(t) && t->in_len >= 4 && !memcmp(t->in, "BZh", 3) &&
+      t->in[3] >= '1' && t->in[3] <= '9') {
+    t->bz2 = 1;
+    if (!bz2_begin(t)) {
+      return 0;
+    }
+    t->bzs.next_in = (char *)t->in;
+    t->bzs.avail_in = t->in_len;
+  }
+
+  if (trace_perf) {
+    t->perf[0].name = "  read (reader)";
+    t->perf[1].name = "  parse (reader)";
+    t->num_perf = 2;
+  }
+
+  pthread_mutex_init(&t->lock, NULL);
+  pthread_cond_init(&t->not_empty, NULL);
+  pthread_cond_init(&t->not_full, NULL);
+  if (pthread_create(&t->reader, NULL, reader_main, t) != 0) {
+    t->error = "cannot start reader thread";
+    return 0;
+  }
+  t->started = 1;
+  return 1;
+}
+
+static size_t
+text_next(struct trace *t, const uint32_t **pcs, const uint8_t **outcomes)
+{
+  pthread_mutex_lock(&t->lock);
+  if (t->holding) {
+    // Hand the previous batch back to the reader
+    t->head = (t->head + 1) % TRACE_RING;
+    t->ready--;
+    t->holding = 0;
+    pthread_cond_signal(&t->not_full);
+  }
+  while (t->ready == 0 && !t->done) {
+    pthread_cond_wait(&t->not_empty, &t->lock);
+  }
+  size_t n = 0;
+  if (t->ready > 0) {
+    struct trace_slot *slot = &t->ring[t->head];
+    *pcs = slot->pcs;
+    *outcomes = slot->outcomes;
+    n = slot->n;
+    t->holding = 1;
+  }
+  pthread_mutex_unlock(&t->lock);
+  return n;
+}
+
+//------------------------------------//
+//           Packed Traces            //
+//------------------------------------//
+
+// Decode a LEB128 varint, returns 0 if it runs past 'end'
+//
+static inline int
+get_varint(const uint8_t **pp, const uint8_t *end, uint64_t *v)
+{
+  const uint8_t *p = *pp;
+  uint64_t r = 0;
+  int shift = 0;
+  while (p < end && shift < 64) {
+    uint8_t b = *p++;
+    r |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      *v = r;
+      *pp = p;
+      return 1;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+// Drop the mapped pages that lie wholly before 'offset'. They are read
+// back from the page cache if they are touched again.
+//
+static void
+release_behind(struct trace *t, size_t offset)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  offset &= ~(page - 1);
+  if (offset > t->released) {
+    madvise(t->map + t->released, offset - t->released, MADV_DONTNEED);
+    t->released = offset;
+  }
+}
+
+static int
+packed_open(struct trace *t, int fd, size_t size)
+{
+  t->map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (t->map == MAP_FAILED) {
+    t->map = NULL;
+    return 0;
+  }
+  t->map_len = size;
+  madvise(t->map, size, MADV_SEQUENTIAL);
+
+  struct bpt_header h;
+  memcpy(&h, t->map, sizeof(h));
+  if (h.version != BPT_VERSION) {
+    fprintf(stderr, "Unsupported packed trace version %u\n", h.version);
+    return 0;
+  }
+  if (h.stream_offset > size || h.stream_bytes > size - h.stream_offset ||
+      h.dict_offset > size || (uint64_t)h.num_pcs * 4 > size - h.dict_offset ||
+      (h.dict_offset & 3)) {
+    fprintf(stderr, "Packed trace is truncated or corrupt\n");
+    return 0;
+  }
+
+  uint64_t sum = BPT_CHECKSUM_INIT;
+  for (uint64_t done = 0; done < h.stream_bytes; done += RELEASE_STEP) {
+    uint64_t len = h.stream_bytes - done < RELEASE_STEP ? h.stream_bytes - done : RELEASE_STEP;
+    sum = bpt_checksum(sum, t->map + h.stream_offset + done, len);
+    release_behind(t, h.stream_offset + done + len);
+  }
+  t->released = 0;
+  sum = bpt_checksum(sum, t->map + h.dict_offset, (size_t)h.num_pcs * 4);
+  if (sum != h.checksum) {
+    fprintf(stderr, "Packed trace checksum mismatch\n");
+    return 0;
+  }
+
+  t->kind = TRACE_PACKED;
+  t->pos = t->map + h.stream_offset;
+  t->end = t->pos + h.stream_bytes;
+  t->dict = (const uint32_t *)(t->map + h.dict_offset);
+  t->num_pcs = h.num_pcs;
+  t->remaining = h.branches;
+  t->index = 0;
+  t->outcome = 0;
+  t->run_left = 0;
+  return 1;
+}
+
+static size_t
+packed_next(struct trace *t)
+{
+  size_t n = 0;
+  size_t want = t->remaining < TRACE_BATCH ? t->remaining : TRACE_BATCH;
+
+  while (n < want) {
+    // Finish the pending run first
+    if (t->run_left) {
+      uint64_t k = want - n;
+      if (k > t->run_left) {
+        k = t->run_left;
+      }
+      uint32_t pc = t->dict[t->index];
+      for (uint64_t i = 0; i < k; i++) {
+        t->pcs[n + i] = pc;
+        t->outcomes[n + i] = t->outcome;
+      }
+      n += k;
+      t->run_left -= k;
+      continue;
+    }
+
+    uint64_t token;
+    if (!get_varint(&t->pos, t->end, &token)) {
+      return trace_fail(t, "packed trace stream ends early");
+    }
+    uint64_t zz = token >> 2;
+    int64_t delta = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+    uint32_t index = t->index + (uint32_t)delta;
+    if (index >= t->num_pcs) {
+      return trace_fail(t, "packed trace references a PC outside the dictionary");
+    }
+    t->index = index;
+    t->outcome = (token >> 1) & 1;
+    t->pcs[n] = t->dict[index];
+    t->outcomes[n] = t->outcome;
+    n++;
+
+    if (token & 1) {
+      uint64_t extra;
+      if (!get_varint(&t->pos, t->end, &extra)) {
+        return trace_fail(t, "packed trace stream ends early");
+      }
+      t->run_left = extra + 1;
+    }
+  }
+
+  t->remaining -= n;
+  if ((size_t)(t->pos - t->map) - t->released >= RELEASE_STEP) {
+    release_behind(t, t->pos - t->map);
+  }
+  return n;
+}
+
+//------------------------------------//
+//          Trace Reader API          //
+//------------------------------------//
+
+struct trace *
+trace_open(const char *path)
+{
+  struct trace *t = calloc(1, sizeof(struct trace));
+  t->fd = -1;
+
+  int fd = STDIN_FILENO;
+  if (path == NULL || !strcmp(path, "-")) {
+    path = "<stdin>";
+  } else {
+    fd = open(path, O_RDONLY);
+  }
+  if (fd < 0) {
+    perror(path);
+    free(t);
+    return NULL;
+  }
+
+  // Sniff regular files for the packed format
+  struct stat st;
+  char magic[4];
+  int regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+  if (regular &&
+      st.st_size >= (off_t)sizeof(struct bpt_header) &&
+      pread(fd, magic, 4, 0) == 4 && !memcmp(magic, BPT_MAGIC, 4)) {
+    int ok = packed_open(t, fd, st.st_size);
+    close(fd);
+    if (!ok) {
+      fprintf(stderr, "%s: cannot read packed trace\n", path);
+      trace_close(t);
+      return NULL;
+    }
+    if (trace_perf) {
+      t->perf[0].name = "  decode";
+      t->num_perf = 1;
+      perf_open(&t->counters);
+    }
+    return t;
+  }
+
+  // Large bzip2 files are cut into blocks and decoded on a worker pool
+  int threads = trace_threads > 0 ? trace_threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads > 1 && regular && st.st_size > 4 &&
+      pread(fd, magic, 3, 0) == 3 && !memcmp(magic, "BZh", 3)) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      t->map = map;
+      t->map_len = st.st_size;
+      t->par = bz2_blocks_open(t->map, t->map_len, threads);
+    }
+  }
+
+  if (!text_open(t, fd)) {
+    fprintf(stderr, "%s: %s\n", path, t->error);
+    trace_close(t);
+    return NULL;
+  }
+  return t;
+}
+
+size_t
+trace_next(struct trace *t, const uint32_t **pcs, const uint8_t **outcomes)
+{
+  switch (t->kind)
+  {
+  case TRACE_PACKED:
+    *pcs = t->pcs;
+    *outcomes = t->outcomes;
+    if (t->error) {
+      return 0;
+    }
+    if (t->num_perf) {
+      struct perf_sample sample;
+      perf_begin(&t->counters, &sample);
+      size_t n = packed_next(t);
+      perf_end(&t->counters, &t->perf[0], &sample);
+      return n;
+    }
+    return packed_next(t);
+  default:
+    return text_next(t, pcs, outcomes);
+  }
+}
+
+// The reader thread only writes 'error' before it sets 'done', so it
+// is safe to read once trace_next has returned 0
+//
+const char *
+trace_error(struct trace *t)
+{
+  return t->error;
+}
+
+// Like 'error', the reader thread is done with its phases once
+// trace_next has returned 0
+//
+const struct perf_phase *
+trace_perf_phases(struct trace *t, int *num)
+{
+  *num = t->num_perf;
+  return t->perf;
+}
+
+void
+trace_close(struct trace *t)
+{
+  if (t->started) {
+    pthread_mutex_lock(&t->lock);
+    t->stop = 1;
+    pthread_cond_signal(&t->not_full);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->reader, NULL);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->not_empty);
+    pthread_cond_destroy(&t->not_full);
+  }
+  if (t->bz2_active) {
+    BZ2_bzDecompressEnd(&t->bzs);
+  }
+  if (t->par) {
+    bz2_blocks_close(t->par);
+  }
+  if (t->fd > STDIN_FILENO) {
+    close(t->fd);
+  }
+  if (t->map) {
+    munmap(t->map, t->map_len);
+  }
+  if (t->kind == TRACE_PACKED && t->num_perf) {
+    perf_close(&t->counters);
+  }
+  free(t);
+}
+
+//------------------------------------//
+//        Packed Trace Writer         //
+//------------------------------------//
+
+#define WRITER_CHUNK (1 << 16)
+
+struct bpt_writer
+{
+  FILE *out;
+  uint64_t branches;
+  uint64_t checksum;
+  uint64_t stream_bytes;
+
+  // PC -> dictionary index, open addressing over 'keys'/'vals'
+  uint32_t *keys;
+  uint32_t *vals;
+  uint8_t *used;
+  uint32_t slots;
+  uint32_t *dict;
+  uint32_t num_pcs;
+
+  // Pending run of identical records
+  uint32_t index;
+  uint32_t prev_index;
+  uint8_t outcome;
+  uint64_t run;
+
+  uint8_t chunk[WRITER_CHUNK];
+  size_t chunk_len;
+};
+
+static void
+writer_flush(struct bpt_writer *w)
+{
+  w->checksum = bpt_checksum(w->checksum, w->chunk, w->chunk_len);
+  fwrite(w->chunk, 1, w->chunk_len, w->out);
+  w->stream_bytes += w->chunk_len;
+  w->chunk_len = 0;
+}
+
+static void
+put_varint(struct bpt_writer *w, uint64_t v)
+{
+  if (w->chunk_len + 10 > WRITER_CHUNK) {
+    writer_flush(w);
+  }
+  while (v >= 0x80) {
+    w->chunk[w->chunk_len++] = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  w->chunk[w->chunk_len++] = (uint8_t)v;
+}
+
+static inline uint32_t
+pc_hash(uint32_t pc)
+{
+  return (pc * 0x9e3779b1u) ^ (pc >> 15);
+}
+
+static void
+writer_grow(struct bpt_writer *w)
+{
+  uint32_t slots = w->slots ? w->slots * 2 : 1024;
+  uint32_t *keys = calloc(slots, sizeof(uint32_t));
+  uint32_t *vals = calloc(slots, sizeof(uint32_t));
+  uint8_t *used = calloc(slots, 1);
+  for (uint32_t i = 0; i < w->slots; i++) {
+    if (!w->used[i]) {
+      continue;
+    }
+    uint32_t s = pc_hash(w->keys[i]) & (slots - 1);
+    while (used[s]) {
+      s = (s + 1) & (slots - 1);
+    }
+    used[s] = 1;
+    keys[s] = w->keys[i];
+    vals[s] = w->vals[i];
+  }
+  free(w->keys);
+  free(w->vals);
+  free(w->used);
+  w->keys = keys;
+  w->vals = vals;
+  w->used = used;
+  w->slots = slots;
+  w->dict = realloc(w->dict, (slots / 2) * sizeof(uint32_t));
+}
+
+static uint32_t
+writer_lookup(struct bpt_writer *w, uint32_t pc)
+{
+  uint32_t s = pc_hash(pc) & (w->slots - 1);
+  while (w->used[s]) {
+    if (w->keys[s] == pc) {
+      return w->vals[s];
+    }
+    s = (s + 1) & (w->slots - 1);
+  }
+
+  // Keep the load factor at or below 1/2
+  if (w->num_pcs + 1 > w->slots / 2) {
+    writer_grow(w);
+    return writer_lookup(w, pc);
+  }
+  w->used[s] = 1;
+  w->keys[s] = pc;
+  w->vals[s] = w->num_pcs;
+  w->dict[w->num_pcs] = pc;
+  return w->num_pcs++;
+}
+
+static void
+writer_emit_run(struct bpt_writer *w)
+{
+  if (w->run == 0) {
+    return;
+  }
+  int64_t delta = (int64_t)w->index - (int64_t)w->prev_index;
+  uint64_t zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+  put_varint(w, zz << 2 | (uint64_t)w->outcome << 1 | (w->run > 1));
+  if (w->run > 1) {
+    put_varint(w, w->run - 2);
+  }
+  w->prev_index = w->index;
+  w->run = 0;
+}
+
+struct bpt_writer *
+bpt_writer_open(const char *path)
+{
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return NULL;
+  }
+
+  struct bpt_writer *w = calloc(1, sizeof(struct bpt_writer));
+  w->out = out;
+  w->checksum = BPT_CHECKSUM_INIT;
+  writer_grow(w);
+
+  // Reserve room for the header
+  struct bpt_header h;
+  memset(&h, 0, sizeof(h));
+  fwrite(&h, sizeof(h), 1, out);
+  return w;
+}
+
+void
+bpt_writer_add(struct bpt_writer *w, uint32_t pc, uint8_t outcome)
+{
+  uint32_t index = writer_lookup(w, pc);
+  w->branches++;
+  if (w->run && index == w->index && outcome == w->outcome) {
+    w->run++;
+    return;
+  }
+  writer_emit_run(w);
+  w->index = index;
+  w->outcome = outcome & 1;
+  w->run = 1;
+}
+
+int
+bpt_writer_close(struct bpt_writer *w)
+{
+  writer_emit_run(w);
+  writer_flush(w);
+
+  struct bpt_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, BPT_MAGIC, 4);
+  h.version = BPT_VERSION;
+  h.branches = w->branches;
+  h.stream_offset = sizeof(h);
+  h.stream_bytes = w->stream_bytes;
+  h.num_pcs = w->num_pcs;
+
+  // Align the dictionary so the reader can use it in place
+  uint8_t zero[4] = {0, 0, 0, 0};
+  size_t pad = (4 - (h.stream_offset + h.stream_bytes) % 4) % 4;
+  fwrite(zero, 1, pad, w->out);
+  h.dict_offset = h.stream_offset + h.stream_bytes + pad;
+  fwrite(w->dict, sizeof(uint32_t), w->num_pcs, w->out);
+
+  h.checksum = bpt_checksum(w->checksum, (const uint8_t *)w->dict, (size_t)w->num_pcs * 4);
+
+  int failed = fseek(w->out, 0, SEEK_SET) != 0 ||
+               fwrite(&h, sizeof(h), 1, w->out) != 1;
+  failed |= fclose(w->out) != 0;
+
+  free(w->keys);
+  free(w->vals);
+  free(w->used);
+  free(w->dict);
+  free(w);
+  return failed ? -1 : 0;
+}
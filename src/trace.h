@@ -0,0 +1,122 @@
+//========================================================//
+//  trace.h                                               //
+//  Header file for the branch trace readers              //
+//                                                        //
+//  A trace is consumed in batches of (pc, outcome)       //
+//  records regardless of the on-disk format              //
+//========================================================//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// Maximum number of records handed out per trace_next call
+#define TRACE_BATCH 4096
+
+//------------------------------------//
+//     Packed Binary Trace Format     //
+//------------------------------------//
+//
+// A packed trace (.bpt) is laid out as
+//
+//   header | outcome stream | PC dictionary
+//
+// The dictionary holds every distinct PC as a little-endian uint32_t in
+// first-seen order. The stream encodes one token per run of identical
+// records as a LEB128 varint:
+//
+//   token = zigzag(index - previous index) << 2 | outcome << 1 | run
+//
+// If the run bit is set the token is followed by a second varint holding
+// the number of extra repetitions minus one. The checksum covers the
+// stream and the dictionary.
+//
+#define BPT_MAGIC   "BPT\x1a"
+#define BPT_VERSION 1
+
+struct bpt_header
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t branches;       // Number of records in the trace
+  uint64_t checksum;       // bpt_checksum over stream + dictionary
+  uint64_t stream_offset;  // Byte offset of the outcome stream
+  uint64_t stream_bytes;   // Length of the outcome stream
+  uint64_t dict_offset;    // Byte offset of the PC dictionary
+  uint32_t num_pcs;        // Number of dictionary entries
+  uint32_t reserved;
+  uint64_t pad;
+};
+
+uint64_t bpt_checksum(uint64_t h, const uint8_t *p, size_t len);
+
+//------------------------------------//
+//          Trace Reader API          //
+//------------------------------------//
+
+struct trace;
+
+// Number of threads used to decompress large bzip2 files, defaults to
+// the number of online CPUs. With 1 thread bzip2 input is decoded as a
+// single stream on the reader thread.
+//
+void trace_set_threads(int threads);
+
+// Time the reading, parsing and decoding of traces opened from now on,
+// see trace_perf_phases
+//
+void trace_set_perf(int enable);
+
+// Open a trace for reading. A NULL path or "-" reads text from stdin,
+// anything else is sniffed for the packed binary format first and read
+// as text otherwise.
+//
+// Returns NULL and prints the reason to stderr on failure
+//
+struct trace *trace_open(const char *path);
+
+// Hand out the next batch of records. The arrays stay valid until the
+// next call on the same trace.
+//
+// Returns the number of records, 0 at the end of the trace or on error
+//
+size_t trace_next(struct trace *t, const uint32_t **pcs, const uint8_t **outcomes);
+
+// Returns a description of the error that ended the trace, or NULL if
+// the trace ended normally
+//
+const char *trace_error(struct trace *t);
+
+struct perf_phase;
+
+// Returns the phases timed inside the reader and sets *num to their
+// number, 0 unless trace_set_perf was on when the trace was opened.
+// They are complete once trace_next has returned 0.
+//
+const struct perf_phase *trace_perf_phases(struct trace *t, int *num);
+
+void trace_close(struct trace *t);
+
+//------------------------------------//
+//        Packed Trace Writer         //
+//------------------------------------//
+
+struct bpt_writer;
+
+// Create a packed trace at 'path'. The file must be seekable since the
+// header is written last.
+//
+struct bpt_writer *bpt_writer_open(const char *path);
+
+void bpt_writer_add(struct bpt_writer *w, uint32_t pc, uint8_t outcome);
+
+// Flush the pending run, write the dictionary and the header
+//
+// Returns 0 on success
+//
+int bpt_writer_close(struct bpt_writer *w);
+
+#endif
@@ -0,0 +1,508 @@
+//========================================================//
+//  tracegen.c                                            //
+//  Generates synthetic branch traces of any length from  //
+//  a parameterized workload mix                          //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+// Kinds of static branches in the workload
+#define KIND_LOOP    0   // Back edges of a loop nest, taken trips - 1 times
+#define KIND_PAIR    1   // A random branch followed by one that repeats it
+#define KIND_BIASED  2   // Goes one fixed way with probability --bias
+#define KIND_RANDOM  3   // Coin flips
+#define KINDS        4
+
+const char *kind_names[KINDS] = {"loop", "pair", "biased", "random"};
+
+#define MAX_TRIPS 16
+
+// One kind of branch and the static instances of it. Instance i owns
+// the static branches first + i * width ... first + i * width + width - 1.
+struct kind
+{
+  double weight;            // Share of the dynamic branches, from --mix
+  uint32_t first;
+  uint32_t width;           // Static branches per instance
+  uint32_t instances;
+  double per_episode;       // Dynamic branches per execution of an instance
+  uint32_t threshold;       // Picked while the random draw is below this
+  uint64_t branches;        // Dynamic branches generated so far
+};
+
+struct kind kinds[KINDS];
+uint32_t trips[MAX_TRIPS];
+int num_trips = 0;
+int last_kind;             // The last kind in the mix
+
+uint64_t num_branches = 10000000;
+uint64_t seed = 1;
+uint32_t footprint = 4096;
+double bias = 0.95;
+uint32_t base = 0x400000;
+uint32_t stride = 4;
+
+void
+usage()
+{
+  fprintf(stderr,"Usage: tracegen <options> [<output>]\n");
+  fprintf(stderr," Writes a synthetic trace to <output> (default stdout), packed if the\n");
+  fprintf(stderr," name ends in .bpt and as text otherwise\n");
+  fprintf(stderr," Options:\n");
+  fprintf(stderr," --help              Print this message\n");
+  fprintf(stderr," --branches=<n>      Number of branches, k/M/G suffixes allowed (default 10M)\n");
+  fprintf(stderr," --seed=<n>          Seed of the random choices (default %llu)\n",
+          (unsigned long long)seed);
+  fprintf(stderr," --mix=<kind>:<w>,.. Share of the branches per kind (default\n");
+  fprintf(stderr,"                     loop:4,pair:2,biased:3,random:1), where <kind> is\n");
+  fprintf(stderr,"                     loop    back edges of a loop nest\n");
+  fprintf(stderr,"                     pair    a random branch, then one that follows it\n");
+  fprintf(stderr,"                     biased  mostly one way, see --bias\n");
+  fprintf(stderr,"                     random  coin flips\n");
+  fprintf(stderr," --trips=<n>,...     Trip counts of the loop nest, outermost first\n");
+  fprintf(stderr,"                     (default 4,16)\n");
+  fprintf(stderr," --bias=<p>          How often, 0 to 1, a biased branch goes its way (default %.2f)\n",
+          bias);
+  fprintf(stderr," --footprint=<n>     Number of static branches (default %u), exact\n"
+                 "                     if the mix has biased or random branches\n", footprint);
+  fprintf(stderr," --base=<pc>         PC of the first static branch (default 0x%x)\n", base);
+  fprintf(stderr," --stride=<n>        Bytes between static branches (default %u)\n", stride);
+}
+
+// Parse a count with an optional k, M or G suffix (powers of 1000)
+//
+// Returns True if Successful
+//
+int
+parse_count(const char *arg, uint64_t *count)
+{
+  char *end;
+  unsigned long long v = strtoull(arg, &end, 10);
+  if (end == arg) {
+    return 0;
+  }
+  switch (*end) {
+    case 'k': case 'K': v *= 1000ULL; end++; break;
+    case 'm': case 'M': v *= 1000000ULL; end++; break;
+    case 'g': case 'G': v *= 1000000000ULL; end++; break;
+  }
+  *count = v;
+  return *end == '\0';
+}
+
+// Returns True if Successful
+//
+int
+parse_mix(const char *arg)
+{
+  for (int k = 0; k < KINDS; k++) {
+    kinds[k].weight = 0;
+  }
+  while (*arg) {
+    size_t len = strcspn(arg, ":,");
+    int k = 0;
+    while (k < KINDS && (strlen(kind_names[k]) != len || strncmp(arg, kind_names[k], len))) {
+      k++;
+    }
+    if (k == KINDS) {
+      fprintf(stderr, "Unknown branch kind %.*s\n", (int)len, arg);
+      return 0;
+    }
+    arg += len;
+    kinds[k].weight = 1;
+    if (*arg == ':') {
+      char *end;
+      kinds[k].weight = strtod(arg + 1, &end);
+      if (end == arg + 1 || kinds[k].weight < 0) {
+        return 0;
+      }
+      arg = end;
+    }
+    if (*arg == ',') {
+      arg++;
+    } else if (*arg) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Returns True if Successful
+//
+int
+parse_trips(const char *arg)
+{
+  num_trips = 0;
+  while (*arg) {
+    char *end;
+    unsigned long t = strtoul(arg, &end, 10);
+    if (end == arg || t < 1 || t > 0xffffffffUL || num_trips == MAX_TRIPS) {
+      return 0;
+    }
+    trips[num_trips++] = t;
+    arg = end + (*end == ',');
+    if (*end && *end != ',') {
+      return 0;
+    }
+  }
+  return num_trips > 0;
+}
+
+// Parse a probability in [0, 1]
+//
+// Returns True if Successful
+//
+int
+parse_probability(const char *arg, double *p)
+{
+  char *end;
+  double v = strtod(arg, &end);
+  if (end == arg || *end || !(v >= 0 && v <= 1)) {
+    return 0;
+  }
+  *p = v;
+  return 1;
+}
+
+// Parse a 32-bit number, decimal or 0x hexadecimal
+//
+// Returns True if Successful
+//
+int
+parse_u32(const char *arg, uint32_t *value)
+{
+  char *end;
+  errno = 0;
+  unsigned long long v = strtoull(arg, &end, 0);
+  if (end == arg || *end || *arg == '-' || errno || v > UINT32_MAX) {
+    return 0;
+  }
+  *value = v;
+  return 1;
+}
+
+//------------------------------------//
+//              Output                //
+//------------------------------------//
+
+#define TEXT_BUFFER (1 << 20)
+
+// Generated branches are collected as static branch indices and written
+// a batch at a time
+uint32_t batch_index[TRACE_BATCH];
+uint8_t batch_outcome[TRACE_BATCH];
+size_t batch_len = 0;
+uint64_t generated = 0;
+
+FILE *text_out;
+struct bpt_writer *packed_out;
+
+// The text of every static branch, "0x<pc> ", padded to 16 bytes with
+// its length in the last one, so that a line is a fixed size copy
+char (*pc_text)[16];
+char *text_buffer;
+size_t text_len = 0;
+
+void
+flush_batch(void)
+{
+  if (packed_out) {
+    for (size_t i = 0; i < batch_len; i++) {
+      bpt_writer_add(packed_out, base + batch_index[i] * stride, batch_outcome[i]);
+    }
+  } else {
+    for (size_t i = 0; i < batch_len; i++) {
+      if (text_len + 18 > TEXT_BUFFER) {
+        fwrite(text_buffer, 1, text_len, text_out);
+        text_len = 0;
+      }
+      const char *t = pc_text[batch_index[i]];
+      memcpy(text_buffer + text_len, t, 16);
+      text_len += t[15];
+      text_buffer[text_len++] = '0' + batch_outcome[i];
+      text_buffer[text_len++] = '\n';
+    }
+  }
+  batch_len = 0;
+}
+
+static inline void
+put(uint32_t index, uint8_t outcome)
+{
+  batch_index[batch_len] = index;
+  batch_outcome[batch_len++] = outcome;
+  generated++;
+  if (batch_len == TRACE_BATCH) {
+    flush_batch();
+  }
+}
+
+//------------------------------------//
+//            Generation              //
+//------------------------------------//
+
+// xorshift64*, so that a seed gives the same trace everywhere
+//
+uint64_t rng_state;
+
+static inline uint32_t
+next_random(void)
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (rng_state * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+// Run one level of the loop nest whose back edges are the static
+// branches first..first + num_trips - 1, outermost first
+//
+void
+run_loop(uint32_t first, int level)
+{
+  for (uint64_t k = 1; k <= trips[level] && generated < num_branches; k++) {
+    if (level + 1 < num_trips) {
+      run_loop(first, level + 1);
+    }
+    if (generated < num_branches) {
+      put(first + level, k < trips[level]);
+    }
+  }
+}
+
+// Split the footprint and the random draws between the kinds
+//
+// Returns the number of static branches used
+//
+uint32_t
+layout(void)
+{
+  double weights = 0, episodes = 0;
+  for (int k = 0; k < KINDS; k++) {
+    weights += kinds[k].weight;
+  }
+
+  double loop_branches = 0, product = 1;
+  for (int i = 0; i < num_trips; i++) {
+    product *= trips[i];
+    loop_branches += product;
+  }
+
+  double remainders[KINDS];
+  uint64_t used = 0;
+  for (int k = 0; k < KINDS; k++) {
+    struct kind *kd = &kinds[k];
+    kd->width = k == KIND_LOOP ? num_trips : k == KIND_PAIR ? 2 : 1;
+    kd->per_episode = k == KIND_LOOP ? loop_branches : kd->width;
+    kd->instances = 0;
+    if (kd->weight > 0) {
+      double share = footprint * kd->weight / weights / kd->width;
+      kd->instances = share < 1 ? 1 : (uint32_t)share;
+      remainders[k] = share - kd->instances;
+      episodes += kd->weight / kd->per_episode;
+      used += kd->instances * kd->width;
+    }
+  }
+
+  // Rounding down leaves some static branches over. They go to whole
+  // instances, the kinds with the largest remainders first, so the
+  // footprint is exact unless no instance is narrow enough to fill it.
+  for (;;) {
+    int best = -1;
+    for (int k = 0; k < KINDS; k++) {
+      if (kinds[k].weight > 0 && used + kinds[k].width <= footprint &&
+          (best < 0 || remainders[k] > remainders[best])) {
+        best = k;
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+    kinds[best].instances++;
+    remainders[best] -= 1;
+    used += kinds[best].width;
+  }
+
+  uint32_t first = 0;
+  for (int k = 0; k < KINDS; k++) {
+    kinds[k].first = first;
+    first += kinds[k].instances * kinds[k].width;
+  }
+
+  // An episode of each kind is drawn with a probability that makes its
+  // share of the branches match the weight
+  double cumulative = 0;
+  for (int k = 0; k < KINDS; k++) {
+    struct kind *kd = &kinds[k];
+    if (kd->weight > 0) {
+      cumulative += kd->weight / kd->per_episode / episodes;
+    }
+    kd->threshold = cumulative >= 1 ? UINT32_MAX : (uint32_t)(cumulative * 4294967296.0);
+    if (kd->weight > 0) {
+      last_kind = k;
+    }
+  }
+  kinds[last_kind].threshold = UINT32_MAX;
+  return first;
+}
+
+void
+generate(void)
+{
+  uint32_t bias_threshold = bias >= 1 ? UINT32_MAX : (uint32_t)(bias * 4294967296.0);
+
+  while (generated < num_branches) {
+    uint32_t r = next_random();
+    int k = 0;
+    while (k < last_kind && r >= kinds[k].threshold) {
+      k++;
+    }
+    struct kind *kd = &kinds[k];
+    uint32_t instance = ((uint64_t)next_random() * kd->instances) >> 32;
+    uint32_t first = kd->first + instance * kd->width;
+    uint64_t before = generated;
+
+    switch (k) {
+      case KIND_LOOP:
+        run_loop(first, 0);
+        break;
+      case KIND_PAIR: {
+        // Half of the pairs repeat the first outcome, half invert it
+        uint8_t outcome = next_random() >> 31;
+        put(first, outcome);
+        if (generated < num_branches) {
+          put(first + 1, outcome ^ (instance & 1));
+        }
+        break;
+      }
+      case KIND_BIASED:
+        // Even instances lean taken, odd ones not taken
+        put(first, (next_random() < bias_threshold) ^ (instance & 1));
+        break;
+      default:
+        put(first, next_random() >> 31);
+        break;
+    }
+    kd->branches += generated - before;
+  }
+  flush_batch();
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *output = NULL;
+
+  parse_mix("loop:4,pair:2,biased:3,random:1");
+  parse_trips("4,16");
+
+  for (int i = 1; i < argc; ++i) {
+    uint64_t v;
+    if (!strcmp(argv[i], "--help")) {
+      usage();
+      exit(0);
+    } else if (!strncmp(argv[i], "--branches=", 11) && parse_count(argv[i] + 11, &v)) {
+      num_branches = v;
+    } else if (!strncmp(argv[i], "--seed=", 7) && parse_count(argv[i] + 7, &v)) {
+      seed = v;
+    } else if (!strncmp(argv[i], "--mix=", 6) && parse_mix(argv[i] + 6)) {
+      continue;
+    } else if (!strncmp(argv[i], "--trips=", 8) && parse_trips(argv[i] + 8)) {
+      continue;
+    } else if (!strncmp(argv[i], "--bias=", 7) && parse_probability(argv[i] + 7, &bias)) {
+      continue;
+    } else if (!strncmp(argv[i], "--footprint=", 12) && parse_count(argv[i] + 12, &v) &&
+               v > 0 && v <= (1U << 28)) {
+      footprint = v;
+    } else if (!strncmp(argv[i], "--base=", 7) && parse_u32(argv[i] + 7, &base)) {
+      continue;
+    } else if (!strncmp(argv[i], "--stride=", 9) && parse_u32(argv[i] + 9, &stride) &&
+               stride > 0) {
+      continue;
+    } else if (strncmp(argv[i], "--", 2) && !output) {
+      output = argv[i];
+    } else {
+      fprintf(stderr, "Unrecognized argument %s\n", argv[i]);
+      usage();
+      exit(1);
+    }
+  }
+
+  double weights = 0;
+  for (int k = 0; k < KINDS; k++) {
+    weights += kinds[k].weight;
+  }
+  if (weights <= 0) {
+    fprintf(stderr, "The mix has no branches\n");
+    exit(1);
+  }
+  uint32_t statics = layout();
+  if ((uint64_t)base + (uint64_t)(statics - 1) * stride > UINT32_MAX) {
+    fprintf(stderr, "%u static branches at a stride of %u do not fit in 32-bit PCs\n",
+            statics, stride);
+    exit(1);
+  }
+
+  size_t len = output ? strlen(output) : 0;
+  if (len > 4 && !strcmp(output + len - 4, ".bpt")) {
+    packed_out = bpt_writer_open(output);
+    if (!packed_out) {
+      exit(1);
+    }
+  } else {
+    text_out = output && strcmp(output, "-") ? fopen(output, "w") : stdout;
+    if (!text_out) {
+      perror(output);
+      exit(1);
+    }
+    text_buffer = malloc(TEXT_BUFFER);
+    pc_text = malloc((size_t)statics * sizeof(*pc_text));
+    for (uint32_t i = 0; i < statics; i++) {
+      int n = snprintf(pc_text[i], 15, "0x%x ", base + i * stride);
+      pc_text[i][15] = n;
+    }
+  }
+
+  // Mix the seed so that nearby seeds give unrelated traces, and never
+  // start xorshift at 0
+  rng_state = (seed + 1) * 0x9E3779B97F4A7C15ULL;
+  generate();
+
+  int failed;
+  if (packed_out) {
+    failed = bpt_writer_close(packed_out) != 0;
+  } else {
+    fwrite(text_buffer, 1, text_len, text_out);
+    failed = ferror(text_out) | (fclose(text_out) != 0);
+  }
+  if (failed) {
+    fprintf(stderr, "%s: write failed\n", output ? output : "stdout");
+    exit(1);
+  }
+
+  // The mispredictions no predictor can avoid: every coin flip, the first
+  // branch of every pair and the minority outcomes of the biased branches.
+  // Loops and the second branch of a pair are fully predictable from
+  // their history.
+  double floor = 0.5 * kinds[KIND_RANDOM].branches +
+                 0.25 * kinds[KIND_PAIR].branches +
+                 (bias < 0.5 ? bias : 1 - bias) * kinds[KIND_BIASED].branches;
+  fprintf(stderr, "Generated %llu branches from %u static branches\n",
+          (unsigned long long)generated, statics);
+  for (int k = 0; k < KINDS; k++) {
+    if (kinds[k].weight > 0) {
+      fprintf(stderr, "  %-7s %6.2f%% of the branches, %u static\n", kind_names[k],
+              generated ? 100.0 * kinds[k].branches / generated : 0.0,
+              kinds[k].instances * kinds[k].width);
+    }
+  }
+  fprintf(stderr, "Ideal mispredict rate %.3f%% (MPKI %.2f)\n",
+          generated ? 100.0 * floor / generated : 0.0,
+          generated ? 1000.0 * floor / generated : 0.0);
+  return 0;
+}
@@ -0,0 +1,61 @@
+//========================================================//
+//  tracepack.c                                           //
+//  Converts text branch traces to the packed binary      //
+//  format read by trace_open                             //
+//========================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+void
+usage()
+{
+  fprintf(stderr,"Usage: tracepack <trace or trace.bz2> <output.bpt>\n");
+  fprintf(stderr,"       bunzip2 -kc trace.bz2 | tracepack - trace.bpt\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  if (argc != 3 || !strcmp(argv[1], "--help")) {
+    usage();
+    exit(argc == 2 ? 0 : 1);
+  }
+
+  struct trace *in = trace_open(argv[1]);
+  if (!in) {
+    exit(1);
+  }
+  struct bpt_writer *out = bpt_writer_open(argv[2]);
+  if (!out) {
+    exit(1);
+  }
+
+  const uint32_t *pcs;
+  const uint8_t *outcomes;
+  size_t n;
+  uint64_t branches = 0;
+  while ((n = trace_next(in, &pcs, &outcomes)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      bpt_writer_add(out, pcs[i], outcomes[i]);
+    }
+    branches += n;
+  }
+
+  if (trace_error(in)) {
+    fprintf(stderr, "%s: %s\n", argv[1], trace_error(in));
+    exit(1);
+  }
+  trace_close(in);
+
+  if (bpt_writer_close(out) != 0) {
+    fprintf(stderr, "%s: write failed\n", argv[2]);
+    exit(1);
+  }
+
+  fprintf(stderr, "Packed %llu branches into %s\n",
+          (unsigned long long)branches, argv[2]);
+  return 0;
+}